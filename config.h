@@ -53,9 +53,14 @@
 #define UTIL_WEIGHT .60
 
 /*
- * Alignment requirement in bytes (either 4 or 8)
+ * Alignment requirement in bytes (8, or 16 on 64-bit builds so that
+ * payloads can hold SSE/AVX data)
  */
+#ifdef __LP64__
+#define ALIGNMENT 16
+#else
 #define ALIGNMENT 8
+#endif
 
 /*
  * Maximum heap size in bytes
@@ -15,11 +15,14 @@
 #include <assert.h>
 #include <float.h>
 #include <time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
 
 #include "mm.h"
 #include "memlib.h"
 #include "fsecs.h"
 #include "config.h"
+#include "trace.h"
 
 /**********************
  * Constants and macros
@@ -29,39 +32,25 @@
 #define MAXLINE     1024 /* max string size */
 #define HDRLINES       4 /* number of header lines in a trace file */
 #define LINENUM(i) (i+5) /* cnvt trace request nums to linenums (origin 1) */
+#define RANGE_CHUNK 4096 /* range records allocated at a time */
 
 /* Returns true if p is ALIGNMENT-byte aligned */
-#define IS_ALIGNED(p)  ((((unsigned int)(p)) % ALIGNMENT) == 0)
+#define IS_ALIGNED(p)  ((((unsigned long)(p)) % ALIGNMENT) == 0)
 
 /****************************** 
  * The key compound data types 
  *****************************/
 
-/* Records the extent of each block's payload */
+/* Records the extent of each block's payload, as a node of a treap
+   ordered by address */
 typedef struct range_t {
     char *lo;              /* low payload address */
     char *hi;              /* high payload address */
-    struct range_t *next;  /* next list element */
+    unsigned int prio;     /* random priority, no lower than a child's */
+    struct range_t *left;  /* ranges below this one */
+    struct range_t *right; /* ranges above this one (or next free node) */
 } range_t;
 
-/* Characterizes a single trace operation (allocator request) */
-typedef struct {
-    enum {ALLOC, FREE, REALLOC} type; /* type of request */
-    int index;                        /* index for free() to use later */
-    int size;                         /* byte size of alloc/realloc request */
-} traceop_t;
-
-/* Holds the information for one trace file*/
-typedef struct {
-    int sugg_heapsize;   /* suggested heap size (unused) */
-    int num_ids;         /* number of alloc/realloc ids */
-    int num_ops;         /* number of distinct requests */
-    int weight;          /* weight for this trace (unused) */
-    traceop_t *ops;      /* array of requests */
-    char **blocks;       /* array of ptrs returned by malloc/realloc... */
-    size_t *block_sizes; /* ... and a corresponding array of payload sizes */
-} trace_t;
-
 /* 
  * Holds the params to the xxx_speed functions, which are timed by fcyc. 
  * This struct is necessary because fcyc accepts only a pointer array
@@ -92,9 +81,24 @@ int verbose = 0;        /* global flag for verbose output */
 static int errors = 0;  /* number of errs found when running student malloc */
 char msg[MAXLINE];      /* for whenever we need to compose an error message */
 
+/* Arenas the mm package splits its heap into (set by -n) */
+static int num_arenas = 1;
+
+/* mm_setopt values for the mm package (set by -T and -M), if not NO_OPT */
+#define NO_OPT (-2)
+static long trim_opt = NO_OPT;
+static long mmap_opt = NO_OPT;
+
+/* Bytes the mm package reserves after each mm_init (set by -R) */
+static size_t reserve_bytes = 0;
+
 /* Directory where default tracefiles are found */
 static char tracedir[MAXLINE] = TRACEDIR;
 
+/* Range records not in use, carved from chunks of RANGE_CHUNK */
+static range_t *free_ranges = NULL;
+static unsigned int range_seed = 2463534242u; /* for range priorities */
+
 /* The filenames of the default tracefiles */
 static char *default_tracefiles[] = {  
     DEFAULT_TRACEFILES, NULL
@@ -105,28 +109,33 @@ static char *default_tracefiles[] = {
  * Function prototypes 
  *********************/
 
-/* these functions manipulate range lists */
-static int add_range(range_t **ranges, char *lo, int size, 
-		     int tracenum, int opnum);
+/* these functions manipulate range trees */
+static size_t add_range(range_t **ranges, char *lo, int size, int align,
+			int tracenum, int opnum);
 static void remove_range(range_t **ranges, char *lo);
+static int in_heap(char *lo, char *hi);
 static void clear_ranges(range_t **ranges);
-
-/* These functions read, allocate, and free storage for traces */
-static trace_t *read_trace(char *tracedir, char *filename);
-static void free_trace(trace_t *trace);
+static range_t *new_range(void);
+static void split_ranges(range_t *t, char *lo, range_t **l, range_t **r);
+static range_t *merge_ranges(range_t *l, range_t *r);
 
 /* Routines for evaluating the correctness and speed of libc malloc */
 static int eval_libc_valid(trace_t *trace, int tracenum);
 static void eval_libc_speed(void *ptr);
+static size_t libc_align(size_t align);
 
 /* Routines for evaluating correctnes, space utilization, and speed 
    of the student's malloc package in mm.c */
 static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges);
 static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges);
 static void eval_mm_speed(void *ptr);
+static void check_size_hints(void);
+static void check_oversize(void);
+static int init_mm(void);
 
 /* Various helper routines */
 static void printresults(int n, stats_t *stats);
+static void printmmstats(int tracenum, char *tracefile);
 static void usage(void);
 static void unix_error(char *msg);
 static void malloc_error(int tracenum, int opnum, char *msg);
@@ -158,7 +167,7 @@ int main(int argc, char **argv)
     /* 
      * Read and interpret the command line arguments 
      */
-    while ((c = getopt(argc, argv, "f:t:hvVgal")) != EOF) {
+    while ((c = getopt(argc, argv, "f:t:n:T:M:R:hvVgal")) != EOF) {
         switch (c) {
 	case 'g': /* Generate summary info for the autograder */
 	    autograder = 1;
@@ -178,6 +187,18 @@ int main(int argc, char **argv)
 	    if (tracedir[strlen(tracedir)-1] != '/') 
 		strcat(tracedir, "/"); /* path always ends with "/" */
 	    break;
+	case 'n': /* Number of arenas to split the heap into */
+	    num_arenas = atoi(optarg);
+	    break;
+	case 'T': /* Trim threshold of the mm package (-1 never trims) */
+	    trim_opt = atol(optarg);
+	    break;
+	case 'M': /* Mmap threshold of the mm package (-1 never maps) */
+	    mmap_opt = atol(optarg);
+	    break;
+	case 'R': /* Bytes the mm package reserves after each mm_init */
+	    reserve_bytes = strtoul(optarg, NULL, 0);
+	    break;
         case 'a': /* Don't check team structure */
             team_check = 0;
             break;
@@ -252,7 +273,13 @@ int main(int argc, char **argv)
 	
 	/* Evaluate the libc malloc package using the K-best scheme */
 	for (i=0; i < num_tracefiles; i++) {
-	    trace = read_trace(tracedir, tracefiles[i]);
+	    if (verbose > 1)
+		printf("Reading tracefile: %s\n", tracefiles[i]);
+	    if ((trace = read_trace(tracedir, tracefiles[i])) == NULL) {
+		errors++;
+		libc_stats[i].valid = 0;
+		continue;
+	    }
 	    libc_stats[i].ops = trace->num_ops;
 	    if (verbose > 1)
 		printf("Checking libc malloc for correctness, ");
@@ -287,9 +314,31 @@ int main(int argc, char **argv)
     /* Initialize the simulated memory system in memlib.c */
     mem_init(); 
 
+    /* Make sure mm_free_sized does not trust a wrong size hint */
+    if (verbose > 1)
+	printf("Checking mm_free_sized with mismatched size hints\n");
+    check_size_hints();
+
+    /* Make sure requests too large for any block fail cleanly */
+    if (verbose > 1)
+	printf("Checking mm malloc with requests near SIZE_MAX\n");
+    check_oversize();
+
+    /* The options keep their values across mm_init */
+    if (trim_opt != NO_OPT && mm_setopt(MM_TRIM_THRESHOLD, trim_opt) < 0)
+	app_error("mm_setopt(MM_TRIM_THRESHOLD) failed");
+    if (mmap_opt != NO_OPT && mm_setopt(MM_MMAP_THRESHOLD, mmap_opt) < 0)
+	app_error("mm_setopt(MM_MMAP_THRESHOLD) failed");
+
     /* Evaluate student's mm malloc package using the K-best scheme */
     for (i=0; i < num_tracefiles; i++) {
-	trace = read_trace(tracedir, tracefiles[i]);
+	if (verbose > 1)
+	    printf("Reading tracefile: %s\n", tracefiles[i]);
+	if ((trace = read_trace(tracedir, tracefiles[i])) == NULL) {
+	    errors++;
+	    mm_stats[i].valid = 0;
+	    continue;
+	}
 	mm_stats[i].ops = trace->num_ops;
 	if (verbose > 1)
 	    printf("Checking mm_malloc for correctness, ");
@@ -303,6 +352,8 @@ int main(int argc, char **argv)
 	    if (verbose > 1)
 		printf("and performance.\n");
 	    mm_stats[i].secs = fsecs(eval_mm_speed, &speed_params);
+	    if (verbose)
+		printmmstats(i, tracefiles[i]);
 	}
 	free_trace(trace);
     }
@@ -367,22 +418,31 @@ int main(int argc, char **argv)
 
 
 /*****************************************************************
- * The following routines manipulate the range list, which keeps 
+ * The following routines manipulate the range tree, which keeps 
  * track of the extent of every allocated block payload. We use the 
- * range list to detect any overlapping allocated blocks.
+ * range tree to detect any overlapping allocated blocks. It is a
+ * treap ordered by payload address, so checks, inserts and removals
+ * take O(log n) expected time, and its records come from a pool
+ * rather than one malloc each.
  ****************************************************************/
 
 /*
  * add_range - As directed by request opnum in trace tracenum,
  *     we've just called the student's mm_malloc to allocate a block of 
- *     size bytes at addr lo. After checking the block for correctness,
- *     we create a range struct for this block and add it to the range list. 
+ *     size bytes at addr lo, aligned to at least align bytes. After checking
+ *     the block for correctness, we create a range struct for this block 
+ *     and add it to the range tree. The range covers all mm_usable_size
+ *     bytes of the block, so that its slack must not overlap anything 
+ *     either. Returns that usable size, which the caller may fill, or 0
+ *     if the block is bad. mm_usable_size is only asked once the payload
+ *     is known to lie in the heap or a mapping.
  */
-static int add_range(range_t **ranges, char *lo, int size, 
-		     int tracenum, int opnum)
+static size_t add_range(range_t **ranges, char *lo, int size, int align,
+			int tracenum, int opnum)
 {
+    size_t usable;
     char *hi = lo + size - 1;
-    range_t *p;
+    range_t *p, *l, *r;
     char msg[MAXLINE];
 
     assert(size > 0);
@@ -395,37 +455,81 @@ static int add_range(range_t **ranges, char *lo, int size,
         return 0;
     }
 
-    /* The payload must lie within the extent of the heap */
-    if ((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) || 
-	(hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi())) {
+    /* A memalign payload must meet the alignment it asked for */
+    if (((unsigned long)lo % align) != 0) {
+	sprintf(msg, "Payload address (%p) not aligned to %d bytes", 
+		lo, align);
+        malloc_error(tracenum, opnum, msg);
+        return 0;
+    }
+
+    /* The payload must lie within the extent of the heap, or within
+       one of the mappings that memlib handed out, first as asked for
+       and then as large as mm_usable_size says it is */
+    if (!in_heap(lo, hi)) {
 	sprintf(msg, "Payload (%p:%p) lies outside heap (%p:%p)",
 		lo, hi, mem_heap_lo(), mem_heap_hi());
 	malloc_error(tracenum, opnum, msg);
         return 0;
     }
+    usable = mm_usable_size(lo);
+    if (usable < size) {
+	sprintf(msg, "mm_usable_size (%lu) smaller than the payload (%d)", 
+		(unsigned long)usable, size);
+        malloc_error(tracenum, opnum, msg);
+        return 0;
+    }
+    hi = lo + usable - 1;
+    if (hi < lo || !in_heap(lo, hi)) {
+	sprintf(msg, "mm_usable_size (%lu) runs past the end of the heap "
+		"or mapping", (unsigned long)usable);
+	malloc_error(tracenum, opnum, msg);
+        return 0;
+    }
 
-    /* The payload must not overlap any other payloads */
-    for (p = *ranges;  p != NULL;  p = p->next) {
-        if ((lo >= p->lo && lo <= p-> hi) ||
-            (hi >= p->lo && hi <= p->hi)) {
-	    sprintf(msg, "Payload (%p:%p) overlaps another payload (%p:%p)\n",
-		    lo, hi, p->lo, p->hi);
-	    malloc_error(tracenum, opnum, msg);
-	    return 0;
-        }
+    /* 
+     * The payload must not overlap any other payloads. The ranges in
+     * the tree are disjoint, so if any of them overlaps the payload,
+     * the last one starting at or below hi does.
+     */
+    l = NULL;
+    for (p = *ranges;  p != NULL; ) {
+	if (p->lo <= hi) {
+	    l = p;
+	    p = p->right;
+	} else {
+	    p = p->left;
+	}
+    }
+    if (l != NULL && l->hi >= lo) {
+	sprintf(msg, "Payload (%p:%p) overlaps another payload (%p:%p)\n",
+		lo, hi, l->lo, l->hi);
+	malloc_error(tracenum, opnum, msg);
+	return 0;
     }
 
     /* 
      * Everything looks OK, so remember the extent of this block 
-     * by creating a range struct and adding it the range list.
+     * by creating a range struct and adding it the range tree.
      */
-    if ((p = (range_t *)malloc(sizeof(range_t))) == NULL)
-	unix_error("malloc error in add_range");
-    p->next = *ranges;
+    p = new_range();
     p->lo = lo;
     p->hi = hi;
-    *ranges = p;
-    return 1;
+    split_ranges(*ranges, lo, &l, &r);
+    *ranges = merge_ranges(merge_ranges(l, p), r);
+    return usable;
+}
+
+/*
+ * in_heap - Return true if the bytes lo through hi lie within the heap
+ *     or within a single mapping that memlib handed out
+ */
+static int in_heap(char *lo, char *hi)
+{
+    if (lo >= (char *)mem_heap_lo() && hi <= (char *)mem_heap_hi() && 
+	lo <= hi)
+	return 1;
+    return mem_is_mapped(lo, hi);
 }
 
 /* 
@@ -435,16 +539,13 @@ static void remove_range(range_t **ranges, char *lo)
 {
     range_t *p;
     range_t **prevpp = ranges;
-    int size;
 
-    for (p = *ranges;  p != NULL; p = p->next) {
-        if (p->lo == lo) {
-	    *prevpp = p->next;
-            size = p->hi - p->lo + 1;
-            free(p);
-            break;
-        }
-        prevpp = &(p->next);
+    for (p = *ranges;  p != NULL && p->lo != lo;  p = *prevpp)
+	prevpp = (lo < p->lo) ? &p->left : &p->right;
+    if (p != NULL) {
+	*prevpp = merge_ranges(p->left, p->right);
+	p->right = free_ranges;
+	free_ranges = p;
     }
 }
 
@@ -453,119 +554,82 @@ static void remove_range(range_t **ranges, char *lo)
  */
 static void clear_ranges(range_t **ranges)
 {
-    range_t *p;
-    range_t *pnext;
-
-    for (p = *ranges;  p != NULL;  p = pnext) {
-        pnext = p->next;
-        free(p);
-    }
+    range_t *p = *ranges;
+
+    if (p == NULL)
+	return;
+    clear_ranges(&p->left);
+    clear_ranges(&p->right);
+    p->right = free_ranges;
+    free_ranges = p;
     *ranges = NULL;
 }
 
-
-/**********************************************
- * The following routines manipulate tracefiles
- *********************************************/
-
 /*
- * read_trace - read a trace file and store it in memory
+ * new_range - Take a range record from the pool, refilling the pool
+ *     with RANGE_CHUNK records at a time, and give it a random priority
  */
-static trace_t *read_trace(char *tracedir, char *filename)
+static range_t *new_range(void)
 {
-    FILE *tracefile;
-    trace_t *trace;
-    char type[MAXLINE];
-    char path[MAXLINE];
-    unsigned index, size;
-    unsigned max_index = 0;
-    unsigned op_index;
-
-    if (verbose > 1)
-	printf("Reading tracefile: %s\n", filename);
+    range_t *p;
+    int i;
 
-    /* Allocate the trace record */
-    if ((trace = (trace_t *) malloc(sizeof(trace_t))) == NULL)
-	unix_error("malloc 1 failed in read_trance");
-	
-    /* Read the trace file header */
-    strcpy(path, tracedir);
-    strcat(path, filename);
-    if ((tracefile = fopen(path, "r")) == NULL) {
-	sprintf(msg, "Could not open %s in read_trace", path);
-	unix_error(msg);
-    }
-    fscanf(tracefile, "%d", &(trace->sugg_heapsize)); /* not used */
-    fscanf(tracefile, "%d", &(trace->num_ids));     
-    fscanf(tracefile, "%d", &(trace->num_ops));     
-    fscanf(tracefile, "%d", &(trace->weight));        /* not used */
-    
-    /* We'll store each request line in the trace in this array */
-    if ((trace->ops = 
-	 (traceop_t *)malloc(trace->num_ops * sizeof(traceop_t))) == NULL)
-	unix_error("malloc 2 failed in read_trace");
-
-    /* We'll keep an array of pointers to the allocated blocks here... */
-    if ((trace->blocks = 
-	 (char **)malloc(trace->num_ids * sizeof(char *))) == NULL)
-	unix_error("malloc 3 failed in read_trace");
-
-    /* ... along with the corresponding byte sizes of each block */
-    if ((trace->block_sizes = 
-	 (size_t *)malloc(trace->num_ids * sizeof(size_t))) == NULL)
-	unix_error("malloc 4 failed in read_trace");
-    
-    /* read every request line in the trace file */
-    index = 0;
-    op_index = 0;
-    while (fscanf(tracefile, "%s", type) != EOF) {
-	switch(type[0]) {
-	case 'a':
-	    fscanf(tracefile, "%u %u", &index, &size);
-	    trace->ops[op_index].type = ALLOC;
-	    trace->ops[op_index].index = index;
-	    trace->ops[op_index].size = size;
-	    max_index = (index > max_index) ? index : max_index;
-	    break;
-	case 'r':
-	    fscanf(tracefile, "%u %u", &index, &size);
-	    trace->ops[op_index].type = REALLOC;
-	    trace->ops[op_index].index = index;
-	    trace->ops[op_index].size = size;
-	    max_index = (index > max_index) ? index : max_index;
-	    break;
-	case 'f':
-	    fscanf(tracefile, "%ud", &index);
-	    trace->ops[op_index].type = FREE;
-	    trace->ops[op_index].index = index;
-	    break;
-	default:
-	    printf("Bogus type character (%c) in tracefile %s\n", 
-		   type[0], path);
-	    exit(1);
+    if (free_ranges == NULL) {
+	if ((p = (range_t *)malloc(RANGE_CHUNK * sizeof(range_t))) == NULL)
+	    unix_error("malloc error in new_range");
+	for (i = 0; i < RANGE_CHUNK; i++) {
+	    p[i].right = free_ranges;
+	    free_ranges = &p[i];
 	}
-	op_index++;
-	
     }
-    fclose(tracefile);
-    assert(max_index == trace->num_ids - 1);
-    assert(trace->num_ops == op_index);
-    
-    return trace;
+    p = free_ranges;
+    free_ranges = p->right;
+
+    /* xorshift, so the driver's use of rand() is left alone */
+    range_seed ^= range_seed << 13;
+    range_seed ^= range_seed >> 17;
+    range_seed ^= range_seed << 5;
+    p->prio = range_seed;
+    p->left = p->right = NULL;
+    return p;
 }
 
 /*
- * free_trace - Free the trace record and the three arrays it points
- *              to, all of which were allocated in read_trace().
+ * split_ranges - Split the range tree t into the ranges that start
+ *     below lo, returned in *l, and the rest, returned in *r
  */
-void free_trace(trace_t *trace)
+static void split_ranges(range_t *t, char *lo, range_t **l, range_t **r)
 {
-    free(trace->ops);         /* free the three arrays... */
-    free(trace->blocks);      
-    free(trace->block_sizes);
-    free(trace);              /* and the trace record itself... */
+    if (t == NULL) {
+	*l = *r = NULL;
+    } else if (t->lo < lo) {
+	split_ranges(t->right, lo, &t->right, r);
+	*l = t;
+    } else {
+	split_ranges(t->left, lo, l, &t->left);
+	*r = t;
+    }
 }
 
+/*
+ * merge_ranges - Join the range trees l and r, where every range in l
+ *     lies below every range in r, and return the result
+ */
+static range_t *merge_ranges(range_t *l, range_t *r)
+{
+    if (l == NULL)
+	return r;
+    if (r == NULL)
+	return l;
+    if (l->prio > r->prio) {
+	l->right = merge_ranges(l->right, r);
+	return l;
+    }
+    r->left = merge_ranges(l, r->left);
+    return r;
+}
+
+
 /**********************************************************************
  * The following functions evaluate the correctness, space utilization,
  * and throughput of the libc and mm malloc packages.
@@ -579,17 +643,21 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
     int i, j;
     int index;
     int size;
+    int align;
+    int count;
+    char *msg;
     int oldsize;
+    size_t usable;
     char *newp;
     char *oldp;
     char *p;
     
-    /* Reset the heap and free any records in the range list */
+    /* Reset the heap and free any records in the range tree */
     mem_reset_brk();
     clear_ranges(ranges);
 
     /* Call the mm package's init function */
-    if (mm_init() < 0) {
+    if (init_mm() < 0) {
 	malloc_error(tracenum, 0, "mm_init failed.");
 	return 0;
     }
@@ -602,27 +670,52 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
         switch (trace->ops[i].type) {
 
         case ALLOC: /* mm_malloc */
-
-	    /* Call the student's malloc */
-	    if ((p = mm_malloc(size)) == NULL) {
-		malloc_error(tracenum, i, "mm_malloc failed.");
+        case MEMALIGN: /* mm_memalign */
+        case CALLOC: /* mm_calloc */
+
+	    /* Call the student's malloc, memalign or calloc */
+	    align = ALIGNMENT;
+	    if (trace->ops[i].type == MEMALIGN) {
+		align = trace->ops[i].align;
+		p = mm_memalign(align, size);
+		msg = "mm_memalign failed.";
+	    } else if (trace->ops[i].type == CALLOC) {
+		p = mm_calloc(1, size);
+		msg = "mm_calloc failed.";
+	    } else {
+		p = mm_malloc(size);
+		msg = "mm_malloc failed.";
+	    }
+	    if (p == NULL) {
+		malloc_error(tracenum, i, msg);
 		return 0;
 	    }
 	    
 	    /* 
 	     * Test the range of the new block for correctness and add it 
-	     * to the range list if OK. The block must be  be aligned properly,
+	     * to the range tree if OK. The block must be  be aligned properly,
 	     * and must not overlap any currently allocated block. 
 	     */ 
-	    if (add_range(ranges, p, size, tracenum, i) == 0)
+	    if ((usable = add_range(ranges, p, size, align, tracenum, i)) == 0)
 		return 0;
+
+	    /* A calloc'ed block must read as zero */
+	    if (trace->ops[i].type == CALLOC) {
+		for (j = 0; j < size; j++) {
+		    if (p[j] != 0) {
+			malloc_error(tracenum, i, "mm_calloc did not zero "
+				     "the block");
+			return 0;
+		    }
+		}
+	    }
 	    
 	    /* ADDED: cgw
 	     * fill range with low byte of index.  This will be used later
 	     * if we realloc the block and wish to make sure that the old
 	     * data was copied to the new block
 	     */
-	    memset(p, index & 0xFF, size);
+	    memset(p, index & 0xFF, usable);
 
 	    /* Remember region */
 	    trace->blocks[index] = p;
@@ -638,11 +731,12 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 		return 0;
 	    }
 	    
-	    /* Remove the old region from the range list */
+	    /* Remove the old region from the range tree */
 	    remove_range(ranges, oldp);
 	    
-	    /* Check new block for correctness and add it to range list */
-	    if (add_range(ranges, newp, size, tracenum, i) == 0)
+	    /* Check new block for correctness and add it to range tree */
+	    if ((usable = add_range(ranges, newp, size, ALIGNMENT, tracenum, 
+				    i)) == 0)
 		return 0;
 	    
 	    /* ADDED: cgw
@@ -653,13 +747,13 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	    oldsize = trace->block_sizes[index];
 	    if (size < oldsize) oldsize = size;
 	    for (j = 0; j < oldsize; j++) {
-	      if (newp[j] != (index & 0xFF)) {
+	      if ((unsigned char)newp[j] != (index & 0xFF)) {
 		malloc_error(tracenum, i, "mm_realloc did not preserve the "
 			     "data from old block");
 		return 0;
 	      }
 	    }
-	    memset(newp, index & 0xFF, size);
+	    memset(newp, index & 0xFF, usable);
 
 	    /* Remember region */
 	    trace->blocks[index] = newp;
@@ -668,12 +762,51 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 
         case FREE: /* mm_free */
 	    
-	    /* Remove region from list and call student's free function */
+	    /* Remove region from tree and call student's free function */
 	    p = trace->blocks[index];
 	    remove_range(ranges, p);
 	    mm_free(p);
 	    break;
 
+        case FREE_SIZED: /* mm_free_sized */
+	    
+	    /* As for mm_free, passing the size the block was asked for */
+	    p = trace->blocks[index];
+	    remove_range(ranges, p);
+	    mm_free_sized(p, size);
+	    break;
+
+        case ALLOC_BATCH: /* mm_malloc_batch */
+
+	    /* Call the student's batch malloc on the slots of the ids */
+	    count = trace->ops[i].count;
+	    if (mm_malloc_batch(size, count, 
+				(void **)&trace->blocks[index]) != (size_t)count) {
+		malloc_error(tracenum, i, "mm_malloc_batch failed.");
+		return 0;
+	    }
+
+	    /* Check, fill and remember each block as for mm_malloc */
+	    for (j = index; j < index + count; j++) {
+		p = trace->blocks[j];
+		if ((usable = add_range(ranges, p, size, ALIGNMENT, 
+					tracenum, i)) == 0)
+		    return 0;
+		memset(p, j & 0xFF, usable);
+		trace->block_sizes[j] = size;
+	    }
+	    break;
+
+        case FREE_BATCH: /* mm_free_batch */
+
+	    /* Remove the regions, then free them all at once (the
+	       student's batch free may reorder the dead slots) */
+	    count = trace->ops[i].count;
+	    for (j = index; j < index + count; j++)
+		remove_range(ranges, trace->blocks[j]);
+	    mm_free_batch((void **)&trace->blocks[index], count);
+	    break;
+
 	default:
 	    app_error("Nonexistent request type in eval_mm_valid");
         }
@@ -691,14 +824,15 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
  *   Utilization is the ratio hwm/heapsize, where heapsize is the 
  *   size of the heap in bytes after running the student's malloc 
  *   package on the trace. Note that our implementation of mem_sbrk() 
- *   doesn't allow the students to decrement the brk pointer, so brk
- *   is always the high water mark of the heap. 
+ *   remembers the largest the heap has ever been, so a package that
+ *   trims its heap with a negative mem_sbrk is still charged for its
+ *   high water mark. 
  *   
  */
 static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 {   
-    int i;
-    int index;
+    int i, j;
+    int index, count;
     int size, newsize, oldsize;
     int max_total_size = 0;
     int total_size = 0;
@@ -707,17 +841,25 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 
     /* initialize the heap and the mm malloc package */
     mem_reset_brk();
-    if (mm_init() < 0)
+    if (init_mm() < 0)
 	app_error("mm_init failed in eval_mm_util");
 
     for (i = 0;  i < trace->num_ops;  i++) {
         switch (trace->ops[i].type) {
 
         case ALLOC: /* mm_alloc */
+        case MEMALIGN: /* mm_memalign */
+        case CALLOC: /* mm_calloc */
 	    index = trace->ops[i].index;
 	    size = trace->ops[i].size;
 
-	    if ((p = mm_malloc(size)) == NULL) 
+	    if (trace->ops[i].type == MEMALIGN)
+		p = mm_memalign(trace->ops[i].align, size);
+	    else if (trace->ops[i].type == CALLOC)
+		p = mm_calloc(1, size);
+	    else
+		p = mm_malloc(size);
+	    if (p == NULL) 
 		app_error("mm_malloc failed in eval_mm_util");
 	    
 	    /* Remember region and size */
@@ -756,11 +898,15 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 	    break;
 
         case FREE: /* mm_free */
+        case FREE_SIZED: /* mm_free_sized */
 	    index = trace->ops[i].index;
 	    size = trace->block_sizes[index];
 	    p = trace->blocks[index];
 	    
-	    mm_free(p);
+	    if (trace->ops[i].type == FREE_SIZED)
+		mm_free_sized(p, size);
+	    else
+		mm_free(p);
 	    
 	    /* Keep track of current total size
 	     * of all allocated blocks */
@@ -768,13 +914,41 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 	    
 	    break;
 
+        case ALLOC_BATCH: /* mm_malloc_batch */
+	    index = trace->ops[i].index;
+	    size = trace->ops[i].size;
+	    count = trace->ops[i].count;
+
+	    if (mm_malloc_batch(size, count, 
+				(void **)&trace->blocks[index]) != (size_t)count)
+		app_error("mm_malloc_batch failed in eval_mm_util");
+	    for (j = index; j < index + count; j++)
+		trace->block_sizes[j] = size;
+	    
+	    /* Keep track of current total size
+	     * of all allocated blocks */
+	    total_size += size * count;
+	    
+	    /* Update statistics */
+	    max_total_size = (total_size > max_total_size) ?
+		total_size : max_total_size;
+	    break;
+
+        case FREE_BATCH: /* mm_free_batch */
+	    index = trace->ops[i].index;
+	    count = trace->ops[i].count;
+	    for (j = index; j < index + count; j++)
+		total_size -= trace->block_sizes[j];
+	    mm_free_batch((void **)&trace->blocks[index], count);
+	    break;
+
 	default:
 	    app_error("Nonexistent request type in eval_mm_util");
 
         }
     }
 
-    return ((double)max_total_size / (double)mem_heapsize());
+    return ((double)max_total_size / (double)mem_heap_peak());
 }
 
 
@@ -784,13 +958,13 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
  */
 static void eval_mm_speed(void *ptr)
 {
-    int i, index, size, newsize;
+    int i, index, size, newsize, count;
     char *p, *newp, *oldp, *block;
     trace_t *trace = ((speed_t *)ptr)->trace;
 
     /* Reset the heap and initialize the mm package */
     mem_reset_brk();
-    if (mm_init() < 0) 
+    if (init_mm() < 0) 
 	app_error("mm_init failed in eval_mm_speed");
 
     /* Interpret each trace request */
@@ -805,6 +979,22 @@ static void eval_mm_speed(void *ptr)
             trace->blocks[index] = p;
             break;
 
+        case MEMALIGN: /* mm_memalign */
+            index = trace->ops[i].index;
+            size = trace->ops[i].size;
+            if ((p = mm_memalign(trace->ops[i].align, size)) == NULL)
+		app_error("mm_memalign error in eval_mm_speed");
+            trace->blocks[index] = p;
+            break;
+
+        case CALLOC: /* mm_calloc */
+            index = trace->ops[i].index;
+            size = trace->ops[i].size;
+            if ((p = mm_calloc(1, size)) == NULL)
+		app_error("mm_calloc error in eval_mm_speed");
+            trace->blocks[index] = p;
+            break;
+
 	case REALLOC: /* mm_realloc */
 	    index = trace->ops[i].index;
             newsize = trace->ops[i].size;
@@ -820,11 +1010,146 @@ static void eval_mm_speed(void *ptr)
             mm_free(block);
             break;
 
+        case FREE_SIZED: /* mm_free_sized */
+            index = trace->ops[i].index;
+            block = trace->blocks[index];
+            mm_free_sized(block, trace->ops[i].size);
+            break;
+
+        case ALLOC_BATCH: /* mm_malloc_batch */
+            index = trace->ops[i].index;
+            size = trace->ops[i].size;
+            count = trace->ops[i].count;
+            if (mm_malloc_batch(size, count, 
+				(void **)&trace->blocks[index]) != (size_t)count)
+		app_error("mm_malloc_batch error in eval_mm_speed");
+            break;
+
+        case FREE_BATCH: /* mm_free_batch */
+            index = trace->ops[i].index;
+            count = trace->ops[i].count;
+            mm_free_batch((void **)&trace->blocks[index], count);
+            break;
+
 	default:
 	    app_error("Nonexistent request type in eval_mm_valid");
         }
 }
 
+/*
+ * init_mm - Call the mm package's init function, splitting the heap
+ *     into as many arenas as -n asked for, and reserve what -R asked for
+ */
+static int init_mm(void)
+{
+    if (mm_init_arenas(num_arenas) < 0)
+	return -1;
+    if (reserve_bytes > 0)
+	return mm_reserve(reserve_bytes);
+    return 0;
+}
+
+/*
+ * check_size_hints - Free a block with a size hint that does not match
+ *     it, in a child process. Unless mm.c is built with NDEBUG, it must
+ *     catch the mismatch and abort rather than return.
+ */
+static void check_size_hints(void)
+{
+#ifndef NDEBUG
+    static size_t probes[][2] = {  /* {size requested, size hinted} */
+	{100, 8},     /* a slot freed as one of a smaller class */
+	{1000, 4000}, /* a heap block freed as more than it holds */
+    };
+    unsigned int i;
+    int status;
+    pid_t pid;
+    void *p;
+
+    for (i = 0; i < sizeof(probes) / sizeof(probes[0]); i++) {
+	fflush(stdout);
+	if ((pid = fork()) < 0)
+	    unix_error("fork failed in check_size_hints");
+	if (pid == 0) {
+	    /* the failed assertion is expected, so keep it quiet */
+	    if (freopen("/dev/null", "w", stderr) == NULL)
+		_exit(1);
+	    if (mm_init() < 0 || (p = mm_malloc(probes[i][0])) == NULL)
+		_exit(1);
+	    mm_free_sized(p, probes[i][1]);
+	    _exit(0);
+	}
+	if (waitpid(pid, &status, 0) < 0)
+	    unix_error("waitpid failed in check_size_hints");
+	if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+	    errors++;
+	    printf("ERROR: mm_free_sized accepted a size hint of %lu for a %lu-byte block\n",
+		   (unsigned long)probes[i][1], (unsigned long)probes[i][0]);
+	}
+    }
+#endif
+}
+
+/*
+ * check_oversize - In a child process, resize a slot, a heap block and
+ *     a huge block to sizes no block can hold, near SIZE_MAX, where
+ *     rounding the size up wraps around, and ask for new blocks of those
+ *     sizes with and without an mmap threshold. Each request must fail.
+ */
+static void check_oversize(void)
+{
+    static size_t blocks[] = {100, 1000, 200000};
+    static size_t sizes[] = {~(size_t)0, ~(size_t)0 - 8, ~(size_t)0 - 4095};
+    unsigned int i, j, k;
+    int status, fails = 0;
+    pid_t pid;
+    void *p, *newp;
+
+    fflush(stdout);
+    if ((pid = fork()) < 0)
+	unix_error("fork failed in check_oversize");
+    if (pid == 0) {
+	if (mm_init() < 0)
+	    _exit(0);
+	for (i = 0; i < sizeof(blocks) / sizeof(blocks[0]); i++) {
+	    if ((p = mm_malloc(blocks[i])) == NULL)
+		continue;
+	    for (j = 0; j < sizeof(sizes) / sizeof(sizes[0]); j++) {
+		if ((newp = mm_realloc(p, sizes[j])) != NULL) {
+		    printf("ERROR: mm_realloc of a %lu-byte block to %lu bytes succeeded\n",
+			   (unsigned long)blocks[i], (unsigned long)sizes[j]);
+		    fails++;
+		    p = newp;
+		}
+	    }
+	}
+
+	/* the heap must turn these down even when nothing is mapped */
+	for (k = 0; k < 2; k++) {
+	    if (k == 1)
+		mm_setopt(MM_MMAP_THRESHOLD, -1);
+	    for (j = 0; j < sizeof(sizes) / sizeof(sizes[0]); j++) {
+		if (mm_malloc(sizes[j]) != NULL || mm_calloc(1, sizes[j]) != NULL ||
+		    mm_memalign(64, sizes[j]) != NULL) {
+		    printf("ERROR: mm malloc allocated a block of %lu bytes%s\n",
+			   (unsigned long)sizes[j], 
+			   k ? " with no mmap threshold" : "");
+		    fails++;
+		}
+	    }
+	}
+	fflush(stdout);
+	_exit(fails);
+    }
+    if (waitpid(pid, &status, 0) < 0)
+	unix_error("waitpid failed in check_oversize");
+    if (!WIFEXITED(status)) {
+	errors++;
+	printf("ERROR: mm malloc crashed on a request near SIZE_MAX\n");
+    } else
+	errors += WEXITSTATUS(status);
+}
+
 /*
  * eval_libc_valid - We run this function to make sure that the
  *    libc malloc can run to completion on the set of traces.
@@ -833,7 +1158,7 @@ static void eval_mm_speed(void *ptr)
  */
 static int eval_libc_valid(trace_t *trace, int tracenum)
 {
-    int i, newsize;
+    int i, j, newsize;
     char *p, *newp, *oldp;
 
     for (i = 0;  i < trace->num_ops;  i++) {
@@ -847,6 +1172,24 @@ static int eval_libc_valid(trace_t *trace, int tracenum)
 	    trace->blocks[trace->ops[i].index] = p;
 	    break;
 
+        case MEMALIGN: /* posix_memalign */
+	    if ((errno = posix_memalign((void **)&p,
+					libc_align(trace->ops[i].align),
+					trace->ops[i].size)) != 0) {
+		malloc_error(tracenum, i, "libc posix_memalign failed");
+		unix_error("System message");
+	    }
+	    trace->blocks[trace->ops[i].index] = p;
+	    break;
+
+        case CALLOC: /* calloc */
+	    if ((p = calloc(1, trace->ops[i].size)) == NULL) {
+		malloc_error(tracenum, i, "libc calloc failed");
+		unix_error("System message");
+	    }
+	    trace->blocks[trace->ops[i].index] = p;
+	    break;
+
 	case REALLOC: /* realloc */
             newsize = trace->ops[i].size;
 	    oldp = trace->blocks[trace->ops[i].index];
@@ -858,9 +1201,25 @@ static int eval_libc_valid(trace_t *trace, int tracenum)
 	    break;
 	    
         case FREE: /* free */
+        case FREE_SIZED:
 	    free(trace->blocks[trace->ops[i].index]);
 	    break;
 
+        case ALLOC_BATCH: /* malloc, once per id */
+	    for (j = 0; j < trace->ops[i].count; j++) {
+		if ((p = malloc(trace->ops[i].size)) == NULL) {
+		    malloc_error(tracenum, i, "libc malloc failed");
+		    unix_error("System message");
+		}
+		trace->blocks[trace->ops[i].index + j] = p;
+	    }
+	    break;
+
+        case FREE_BATCH: /* free, once per id */
+	    for (j = 0; j < trace->ops[i].count; j++)
+		free(trace->blocks[trace->ops[i].index + j]);
+	    break;
+
 	default:
 	    app_error("invalid operation type  in eval_libc_valid");
 	}
@@ -876,7 +1235,7 @@ static int eval_libc_valid(trace_t *trace, int tracenum)
  */
 static void eval_libc_speed(void *ptr)
 {
-    int i;
+    int i, j;
     int index, size, newsize;
     char *p, *newp, *oldp, *block;
     trace_t *trace = ((speed_t *)ptr)->trace;
@@ -891,6 +1250,23 @@ static void eval_libc_speed(void *ptr)
 	    trace->blocks[index] = p;
 	    break;
 
+        case MEMALIGN: /* posix_memalign */
+	    index = trace->ops[i].index;
+	    size = trace->ops[i].size;
+	    if (posix_memalign((void **)&p, libc_align(trace->ops[i].align),
+			       size) != 0)
+		unix_error("posix_memalign failed in eval_libc_speed");
+	    trace->blocks[index] = p;
+	    break;
+
+        case CALLOC: /* calloc */
+	    index = trace->ops[i].index;
+	    size = trace->ops[i].size;
+	    if ((p = calloc(1, size)) == NULL)
+		unix_error("calloc failed in eval_libc_speed");
+	    trace->blocks[index] = p;
+	    break;
+
 	case REALLOC: /* realloc */
 	    index = trace->ops[i].index;
 	    newsize = trace->ops[i].size;
@@ -902,19 +1278,87 @@ static void eval_libc_speed(void *ptr)
 	    break;
 	    
         case FREE: /* free */
+        case FREE_SIZED:
 	    index = trace->ops[i].index;
 	    block = trace->blocks[index];
 	    free(block);
 	    break;
+
+        case ALLOC_BATCH: /* malloc, once per id */
+	    index = trace->ops[i].index;
+	    size = trace->ops[i].size;
+	    for (j = 0; j < trace->ops[i].count; j++) {
+		if ((p = malloc(size)) == NULL)
+		    unix_error("malloc failed in eval_libc_speed");
+		trace->blocks[index + j] = p;
+	    }
+	    break;
+
+        case FREE_BATCH: /* free, once per id */
+	    index = trace->ops[i].index;
+	    for (j = 0; j < trace->ops[i].count; j++)
+		free(trace->blocks[index + j]);
+	    break;
 	}
     }
 }
 
+/*
+ * libc_align - Round an alignment up to one posix_memalign accepts, a
+ *     power of two no smaller than a pointer, as memalign would. Traces
+ *     recorded from memalign or aligned_alloc may ask for less.
+ */
+static size_t libc_align(size_t align)
+{
+    size_t a = sizeof(void *);
+
+    while (a < align)
+	a <<= 1;
+    return a;
+}
+
 /*************************************
  * Some miscellaneous helper routines
  ************************************/
 
 
+/*
+ * printmmstats - prints the statistics the mm package gathered over the
+ *     last run of a trace, if it was built to gather any
+ */
+static void printmmstats(int tracenum, char *tracefile)
+{
+    mm_stats_t st;
+    int i;
+
+    if (mm_stats(&st) < 0)
+	return;
+
+    printf("\nAllocator statistics for trace %d (%s):\n", 
+	   tracenum, tracefile);
+    printf("  %lu mallocs, %lu frees, %lu reallocs, %lu huge maps\n",
+	   st.mallocs, st.frees, st.reallocs, st.maps);
+    printf("  %lu fit searches, %lu missed\n", 
+	   st.fit_searches, st.fit_misses);
+    printf("  heap grew %lu times by %lu bytes, trimmed %lu times by "
+	   "%lu bytes\n", st.extends, st.extend_bytes, 
+	   st.trims, st.trim_bytes);
+    printf("  coalesce merged nothing %lu, next %lu, prev %lu, both %lu\n",
+	   st.coalesce[0], st.coalesce[1], st.coalesce[2], st.coalesce[3]);
+    printf("  place split %lu blocks, left %lu bytes unsplit\n",
+	   st.splits, st.split_waste);
+    printf("  %12s%10s%10s%10s%10s\n", 
+	   "from", "search", "request", "split", "growth");
+    for (i = 0; i < MM_HIST_BINS; i++) {
+	if (st.search_len[i] == 0 && st.request_size[i] == 0 &&
+	    st.split_rem[i] == 0 && st.heap_growth[i] == 0)
+	    continue;
+	printf("  %12lu%10lu%10lu%10lu%10lu\n", (i == 0) ? 0 : 1UL << i,
+	       st.search_len[i], st.request_size[i], 
+	       st.split_rem[i], st.heap_growth[i]);
+    }
+}
+
 /*
  * printresults - prints a performance summary for some malloc package
  */
@@ -1004,14 +1448,19 @@ void malloc_error(int tracenum, int opnum, char *msg)
  */
 static void usage(void) 
 {
-    fprintf(stderr, "Usage: mdriver [-hvVal] [-f <file>] [-t <dir>]\n");
+    fprintf(stderr, "Usage: mdriver [-hvVal] [-f <file>] [-t <dir>] [-n <arenas>]\n"
+	    "               [-T <trim threshold>] [-M <mmap threshold>] [-R <bytes>]\n");
     fprintf(stderr, "Options\n");
     fprintf(stderr, "\t-a         Don't check the team structure.\n");
     fprintf(stderr, "\t-f <file>  Use <file> as the trace file.\n");
     fprintf(stderr, "\t-g         Generate summary info for autograder.\n");
     fprintf(stderr, "\t-h         Print this message.\n");
     fprintf(stderr, "\t-l         Run libc malloc as well.\n");
+    fprintf(stderr, "\t-n <n>     Split the mm heap into n arenas.\n");
     fprintf(stderr, "\t-t <dir>   Directory to find default traces.\n");
+    fprintf(stderr, "\t-T <n>     Trim the top of the mm heap past n free bytes (-1: never).\n");
+    fprintf(stderr, "\t-M <n>     Map mm requests of n bytes or more (-1: never).\n");
+    fprintf(stderr, "\t-R <n>     Reserve n bytes of mm heap after each mm_init.\n");
     fprintf(stderr, "\t-v         Print per-trace performance breakdowns.\n");
     fprintf(stderr, "\t-V         Print additional debug info.\n");
 }
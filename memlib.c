@@ -2,7 +2,31 @@
  * memlib.c - a module that simulates the memory system.  Needed because it 
  *            allows us to interleave calls from the student's malloc package 
  *            with the system's malloc package in libc.
+ *
+ *            The simulated heap can be split into up to MEM_MAX_REGIONS
+ *            equal regions, each with its own break, so that several
+ *            independent heaps can grow side by side. Region 0 starts at
+ *            the bottom of the heap and is the one mem_sbrk extends.
+ *
+ *            The heap is an anonymous mapping, so a region that shrinks
+ *            with a negative increment hands the whole pages above its
+ *            new break back to the system. mem_heap_peak remembers the
+ *            high-water mark that shrinking no longer shows.
+ *
+ *            Fresh pages of the mapping read as zero, so each region
+ *            tracks a "known zero" watermark above which no byte was
+ *            ever below its break, or which was decommitted since.
+ *            mem_zero_lo lets a calloc skip clearing memory that sbrk
+ *            has only just handed out.
+ *
+ *            Besides the heap, mem_map hands out independent page-aligned
+ *            mappings for blocks too large to carve from a region. They
+ *            count towards the heap size while they exist and are all
+ *            unmapped when the heap is reset. The live mappings are kept
+ *            in an array sorted by address, so that finding the one that
+ *            starts at, or holds, an address is a binary search.
  */
+#define _GNU_SOURCE    /* for mremap */
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
@@ -10,28 +34,63 @@
 #include <sys/mman.h>
 #include <string.h>
 #include <errno.h>
+#ifdef MM_THREADS
+#include <pthread.h>
+#endif
 
 #include "memlib.h"
 #include "config.h"
 
 /* private variables */
 static char *mem_start_brk;  /* points to first byte of heap */
-static char *mem_brk;        /* points to last byte of heap */
 static char *mem_max_addr;   /* largest legal heap address */ 
+static int mem_nregions;     /* number of regions the heap is split into */
+static size_t mem_span;      /* bytes reserved for each region */
+static char *mem_brk[MEM_MAX_REGIONS]; /* break of each region */
+static size_t mem_size;      /* bytes below the breaks, over all regions */
+static size_t mem_peak;      /* largest mem_size since the last reset */
+static char *mem_zero[MEM_MAX_REGIONS]; /* region bytes from here up are 0 */
+
+/* a mapping handed out by mem_map */
+typedef struct {
+    char *lo;                /* first byte of the mapping */
+    size_t size;             /* length of the mapping in bytes */
+} map_t;
+static map_t *mem_maps;      /* live mappings, in address order */
+static int mem_nmaps;        /* number of live mappings */
+static int mem_maxmaps;      /* number of entries mem_maps has room for */
+#define MAPS_CHUNK 64        /* first size of mem_maps, doubled as needed */
+
+#ifdef MM_THREADS
+/* serializes updates of mem_brk between threads */
+static pthread_mutex_t mem_lock = PTHREAD_MUTEX_INITIALIZER;
+#define LOCK() pthread_mutex_lock(&mem_lock)
+#define UNLOCK() pthread_mutex_unlock(&mem_lock)
+#else
+#define LOCK()
+#define UNLOCK()
+#endif
 
 /* 
  * mem_init - initialize the memory system model
  */
 void mem_init(void)
 {
-    /* allocate the storage we will use to model the available VM */
-    if ((mem_start_brk = (char *)malloc(MAX_HEAP)) == NULL) {
-	fprintf(stderr, "mem_init_vm: malloc error\n");
+    /* map the storage we will use to model the available VM */
+    mem_start_brk = (char *)mmap(NULL, MAX_HEAP, PROT_READ | PROT_WRITE,
+				 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem_start_brk == MAP_FAILED) {
+	fprintf(stderr, "mem_init_vm: mmap error\n");
 	exit(1);
     }
 
     mem_max_addr = mem_start_brk + MAX_HEAP;  /* max legal heap address */
-    mem_brk = mem_start_brk;                  /* heap is empty initially */
+    mem_nregions = 1;                         /* one region spanning it all */
+    mem_span = MAX_HEAP;
+    mem_brk[0] = mem_start_brk;               /* heap is empty initially */
+    mem_zero[0] = mem_start_brk;              /* and all zero */
+    mem_size = mem_peak = 0;
+    mem_nmaps = 0;
 }
 
 /* 
@@ -39,32 +98,107 @@ void mem_init(void)
  */
 void mem_deinit(void)
 {
-    free(mem_start_brk);
+    munmap(mem_start_brk, MAX_HEAP);
 }
 
 /*
- * mem_reset_brk - reset the simulated brk pointer to make an empty heap
+ * mem_reset_brk - reset the simulated brk pointers to make an empty heap
  */
 void mem_reset_brk()
 {
-    mem_brk = mem_start_brk;
+    int i;
+
+    LOCK();
+    for (i = 0; i < mem_nregions; i++)
+	mem_brk[i] = mem_start_brk + i * mem_span;
+    for (i = 0; i < mem_nmaps; i++)
+	munmap(mem_maps[i].lo, mem_maps[i].size);
+    mem_nmaps = 0;
+    mem_size = mem_peak = 0;
+    UNLOCK();
+}
+
+/*
+ * mem_set_regions - split the heap into n empty regions of equal,
+ *    page-aligned size. Returns the size of each region, or 0 if n is
+ *    out of range. Whatever is left past the last region stays unused,
+ *    so no address in a region lies a full region size or more above
+ *    its base. Changing the number of regions decommits the whole
+ *    heap, since the old watermarks no longer match the new regions.
+ */
+size_t mem_set_regions(int n)
+{
+    int i;
+
+    if ((n < 1) || (n > MEM_MAX_REGIONS))
+	return 0;
+
+    LOCK();
+    if (n != mem_nregions) {
+	mem_nregions = n;
+	mem_span = (MAX_HEAP / n) & ~(mem_pagesize() - 1);
+	madvise(mem_start_brk, MAX_HEAP, MADV_DONTNEED);
+	for (i = 0; i < n; i++)
+	    mem_zero[i] = mem_start_brk + i * mem_span;
+    }
+    UNLOCK();
+    mem_reset_brk();
+    return mem_span;
 }
 
 /* 
  * mem_sbrk - simple model of the sbrk function. Extends the heap 
- *    by incr bytes and returns the start address of the new area. In
- *    this model, the heap cannot be shrunk.
+ *    by incr bytes and returns the start address of the new area. A
+ *    negative incr shrinks the heap instead.
  */
 void *mem_sbrk(int incr) 
 {
-    char *old_brk = mem_brk;
+    return mem_sbrk_region(0, incr);
+}
+
+/* 
+ * mem_sbrk_region - mem_sbrk for one region: extends region r by incr
+ *    bytes, failing once the region would run into the next one, or
+ *    shrinks it by -incr bytes and decommits the pages given back. Safe
+ *    to call from several threads when built with MM_THREADS.
+ */
+void *mem_sbrk_region(int r, int incr) 
+{
+    char *old_brk;
+    char *base = mem_start_brk + r * mem_span;
+    char *limit;
+    size_t pagesize = mem_pagesize();
+    char *lo, *hi;
 
-    if ( (incr < 0) || ((mem_brk + incr) > mem_max_addr)) {
+    LOCK();
+    old_brk = mem_brk[r];
+    limit = base + mem_span;
+    if ( ((mem_brk[r] + incr) < base) || ((mem_brk[r] + incr) > limit)) {
+	UNLOCK();
 	errno = ENOMEM;
 	fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
 	return (void *)-1;
     }
-    mem_brk += incr;
+    mem_brk[r] += incr;
+    mem_size += incr;
+    if (mem_size > mem_peak)
+	mem_peak = mem_size;
+    if (mem_brk[r] > mem_zero[r])
+	mem_zero[r] = mem_brk[r];
+
+    /* hand every page wholly above the new break back to the system */
+    if (incr < 0) {
+	lo = mem_start_brk + 
+	    (((mem_brk[r] - mem_start_brk) + pagesize - 1) & ~(pagesize - 1));
+	hi = mem_start_brk + 
+	    (((old_brk - mem_start_brk) + pagesize - 1) & ~(pagesize - 1));
+	if (hi > lo) {
+	    madvise(lo, hi - lo, MADV_DONTNEED);
+	    if (mem_zero[r] <= hi)
+		mem_zero[r] = lo;
+	}
+    }
+    UNLOCK();
     return (void *)old_brk;
 }
 
@@ -77,19 +211,57 @@ void *mem_heap_lo()
 }
 
 /* 
- * mem_heap_hi - return address of last heap byte
+ * mem_heap_hi - return address of last heap byte (the last byte of the
+ *    highest region in use)
  */
 void *mem_heap_hi()
 {
-    return (void *)(mem_brk - 1);
+    char *hi = mem_brk[0];
+    int i;
+
+    for (i = 1; i < mem_nregions; i++)
+	if (mem_brk[i] > mem_start_brk + i * mem_span)
+	    hi = mem_brk[i];
+    return (void *)(hi - 1);
+}
+
+/* 
+ * mem_region_hi - return address of the last byte of region r
+ */
+void *mem_region_hi(int r)
+{
+    return (void *)(mem_brk[r] - 1);
 }
 
 /*
- * mem_heapsize() - returns the heap size in bytes
+ * mem_zero_lo - return the lowest address of region r from which every
+ *    byte up to the end of the region is known to read as zero
+ */
+void *mem_zero_lo(int r)
+{
+    char *lo;
+
+    LOCK();
+    lo = mem_zero[r];
+    UNLOCK();
+    return (void *)lo;
+}
+
+/*
+ * mem_heapsize() - returns the heap size in bytes, summed over regions
  */
 size_t mem_heapsize() 
 {
-    return (size_t)(mem_brk - mem_start_brk);
+    return mem_size;
+}
+
+/*
+ * mem_heap_peak() - returns the largest heap size in bytes reached since
+ *    the heap was last reset
+ */
+size_t mem_heap_peak() 
+{
+    return mem_peak;
 }
 
 /*
@@ -99,3 +271,172 @@ size_t mem_pagesize()
 {
     return (size_t)getpagesize();
 }
+
+/*
+ * mem_find_map - return the number of mappings that start at or below
+ *    ptr, so that the one holding ptr, if any, is mem_maps[result - 1].
+ *    The caller holds mem_lock.
+ */
+static int mem_find_map(void *ptr)
+{
+    int lo = 0, hi = mem_nmaps, mid;
+
+    while (lo < hi) {
+	mid = (lo + hi) / 2;
+	if (mem_maps[mid].lo <= (char *)ptr)
+	    lo = mid + 1;
+	else
+	    hi = mid;
+    }
+    return lo;
+}
+
+/*
+ * mem_add_map - enter the mapping of size bytes at lo into mem_maps,
+ *    growing the array if it is full. Returns -1 if it cannot grow.
+ *    The caller holds mem_lock.
+ */
+static int mem_add_map(char *lo, size_t size)
+{
+    map_t *maps;
+    int max, i;
+
+    if (mem_nmaps == mem_maxmaps) {
+	max = (mem_maxmaps == 0) ? MAPS_CHUNK : 2 * mem_maxmaps;
+	if ((maps = (map_t *)realloc(mem_maps, max * sizeof(map_t))) == NULL)
+	    return -1;
+	mem_maps = maps;
+	mem_maxmaps = max;
+    }
+    i = mem_find_map(lo);
+    memmove(&mem_maps[i + 1], &mem_maps[i], (mem_nmaps - i) * sizeof(map_t));
+    mem_maps[i].lo = lo;
+    mem_maps[i].size = size;
+    mem_nmaps++;
+    return 0;
+}
+
+/*
+ * mem_remove_map - drop mem_maps[i]. The caller holds mem_lock.
+ */
+static void mem_remove_map(int i)
+{
+    mem_nmaps--;
+    memmove(&mem_maps[i], &mem_maps[i + 1], (mem_nmaps - i) * sizeof(map_t));
+}
+
+/*
+ * mem_map - map size bytes, rounded up to whole pages, apart from the
+ *    heap. Returns the page-aligned start of the mapping, or NULL.
+ */
+void *mem_map(size_t size)
+{
+    size_t pagesize = mem_pagesize();
+    char *lo;
+
+    size = (size + pagesize - 1) & ~(pagesize - 1);
+    lo = (char *)mmap(NULL, size, PROT_READ | PROT_WRITE,
+		      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (lo == MAP_FAILED)
+	return NULL;
+
+    LOCK();
+    if (mem_add_map(lo, size) < 0) {
+	UNLOCK();
+	munmap(lo, size);
+	return NULL;
+    }
+    mem_size += size;
+    if (mem_size > mem_peak)
+	mem_peak = mem_size;
+    UNLOCK();
+    return (void *)lo;
+}
+
+/*
+ * mem_remap - resize the mapping at ptr to newsize bytes, rounded up to
+ *    whole pages, keeping its contents. The mapping may move; returns
+ *    its new start, or NULL if it could not be resized.
+ */
+void *mem_remap(void *ptr, size_t newsize)
+{
+    size_t pagesize = mem_pagesize();
+    size_t oldsize;
+    char *lo;
+    int i;
+
+    newsize = (newsize + pagesize - 1) & ~(pagesize - 1);
+    LOCK();
+    i = mem_find_map(ptr) - 1;
+    if (i < 0 || mem_maps[i].lo != (char *)ptr) {
+	UNLOCK();
+	return NULL;
+    }
+    oldsize = mem_maps[i].size;
+    if (newsize == oldsize) {
+	UNLOCK();
+	return ptr;
+    }
+#ifdef MREMAP_MAYMOVE
+    lo = (char *)mremap(ptr, oldsize, newsize, MREMAP_MAYMOVE);
+    if (lo == MAP_FAILED) {
+	UNLOCK();
+	return NULL;
+    }
+#else
+    lo = (char *)mmap(NULL, newsize, PROT_READ | PROT_WRITE,
+		      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (lo == MAP_FAILED) {
+	UNLOCK();
+	return NULL;
+    }
+    memcpy(lo, ptr, (newsize < oldsize) ? newsize : oldsize);
+    munmap(ptr, oldsize);
+#endif
+    mem_size += newsize - oldsize;
+    if (mem_size > mem_peak)
+	mem_peak = mem_size;
+
+    /* a mapping that moved takes its place elsewhere in the order; the
+       entry just freed leaves room to insert it again */
+    mem_remove_map(i);
+    mem_add_map(lo, newsize);
+    UNLOCK();
+    return (void *)lo;
+}
+
+/*
+ * mem_unmap - release the mapping that mem_map returned at ptr
+ */
+void mem_unmap(void *ptr)
+{
+    size_t size;
+    int i;
+
+    LOCK();
+    i = mem_find_map(ptr) - 1;
+    if (i < 0 || mem_maps[i].lo != (char *)ptr) {
+	UNLOCK();
+	return;
+    }
+    size = mem_maps[i].size;
+    mem_remove_map(i);
+    mem_size -= size;
+    UNLOCK();
+    munmap(ptr, size);
+}
+
+/*
+ * mem_is_mapped - return true if the bytes lo through hi lie within a
+ *    single mapping handed out by mem_map
+ */
+int mem_is_mapped(void *lo, void *hi)
+{
+    int i, found;
+
+    LOCK();
+    i = mem_find_map(lo) - 1;
+    found = (i >= 0 && (char *)hi < mem_maps[i].lo + mem_maps[i].size);
+    UNLOCK();
+    return found;
+}
@@ -1,11 +1,23 @@
 #include <unistd.h>
 
+/* most regions the heap can be split into */
+#define MEM_MAX_REGIONS 64
+
 void mem_init(void);               
 void mem_deinit(void);
 void *mem_sbrk(int incr);
+void *mem_sbrk_region(int r, int incr);
+size_t mem_set_regions(int n);
 void mem_reset_brk(void); 
 void *mem_heap_lo(void);
 void *mem_heap_hi(void);
+void *mem_region_hi(int r);
+void *mem_zero_lo(int r);
 size_t mem_heapsize(void);
+size_t mem_heap_peak(void);
 size_t mem_pagesize(void);
+void *mem_map(size_t size);
+void *mem_remap(void *ptr, size_t newsize);
+void mem_unmap(void *ptr);
+int mem_is_mapped(void *lo, void *hi);
 
@@ -1,13 +1,27 @@
 /*
- * mm-naive.c - The fastest, least memory-efficient malloc package.
+ * mm.c - malloc package built on segregated explicit free lists.
  *
- * In this naive approach, a block is allocated by simply incrementing
- * the brk pointer.  A block is pure payload. There are no headers or
- * footers.  Blocks are never coalesced or reused. Realloc is
- * implemented directly using mm_malloc and mm_free.
+ * Every block carries a 4-byte header holding its size, an allocated
+ * bit and a prev-allocated bit. Only free blocks have a footer, so an
+ * allocated block pays 4 bytes of overhead. Free blocks smaller than
+ * TREE_MIN sit on power-of-two size-class lists, and larger ones in a
+ * red-black tree ordered by size, then address.
  *
- * NOTE TO STUDENTS: Replace this header comment with your own header
- * comment that gives a high level description of your solution.
+ * Requests of at most SLAB_MAX bytes are served from slab runs of
+ * equal slots with no header, and requests of at least mmap_threshold
+ * bytes get a mapping of their own. Everything in between is a
+ * boundary-tag block.
+ *
+ * The heap is divided into arenas, each with its own memlib region,
+ * free lists and slab runs. A thread allocates from its own arena and
+ * moves on to another when that one is full, and mm_free finds a
+ * block's arena from its address. Built with MM_THREADS, each arena
+ * has a lock and each thread a small cache of slab slots.
+ *
+ * An arena grows by a step that adapts to how fast requests arrive,
+ * and hands its top back once the free block there passes
+ * trim_threshold bytes. The search, placement and coalescing policies
+ * are chosen at compile time (see the policies below).
  */
 #include <stdio.h>
 #include <stdlib.h>
@@ -15,8 +29,13 @@
 #include <unistd.h>
 #include <string.h>
 
+#ifdef MM_THREADS
+#include <pthread.h>
+#endif
+
 #include "mm.h"
 #include "memlib.h"
+#include "config.h"
 
 /*********************************************************
  * NOTE TO STUDENTS: Before you do anything else, please
@@ -35,24 +54,99 @@ team_t team = {
     "kzb2826"
 };
 
-/* single word (4) or double word (8) alignment */
-#define ALIGNMENT 8
-
-/* rounds up to the nearest multiple of ALIGNMENT */
-#define ALIGN(size) (((size) + (ALIGNMENT-1)) & ~0x7)
+/* rounds up to the nearest multiple of ALIGNMENT (from config.h) */
+#define ALIGN(size) (((size) + (ALIGNMENT-1)) & ~(ALIGNMENT-1))
 
 
-#define SIZE_T_SIZE (ALIGN(sizeof(size_t)))
-
 /* basic constants and macros */
 #define WSIZE 4
 #define DSIZE 8
-#define CHUNKSIZE (1<<12)
+#define MIN_BLOCK (2 * DSIZE) /* free block: header, two links, footer */
+#define TRIM_THRESHOLD (128 * 1024) /* default top free block to trim past */
+#define MMAP_THRESHOLD (128 * 1024) /* default smallest mapped request */
+#define GROW_IDLE 64 /* fits without growth that halve the growth step */
+#define TREE_SHIFT 11
+#define TREE_MIN (1<<TREE_SHIFT) /* smallest free block kept in the tree */
+#define NUM_CLASSES (TREE_SHIFT - 4) /* segregated lists below TREE_MIN */
+
+/*
+ * Policies, chosen at compile time with -D (see the variants in the
+ * Makefile). Each choice is made by the preprocessor, so a build holds
+ * only the code of its own policies.
+ *
+ * MM_FIT         how find_fit searches the segregated lists
+ * MM_WILDERNESS  whether find_fit saves the top free block for last
+ * MM_SPLIT_MIN   smallest remainder that place splits off a free block
+ * MM_PLACE_HIGH  requests below this size go at the end of a free block
+ * MM_COALESCE    whether mm_free merges a block with free neighbours
+ * MM_CHUNKSIZE   least amount the heap grows by
+ * MM_GROW_MAX    most the heap grows by ahead of demand
+ */
+#define FIT_FIRST 1          /* first block that fits in the class */
+#define FIT_BEST 2           /* smallest block that fits in the class */
+#define FIT_NEXT 3           /* first fit from where the last search ended */
+#define WILDERNESS_ANY 1     /* the top block is a block like any other */
+#define WILDERNESS_LAST 2    /* use the top block only if nothing else fits */
+#define COALESCE_IMMEDIATE 1 /* merge on every free */
+#define COALESCE_NEVER 2     /* leave freed blocks unmerged */
+#define COALESCE_DEFERRED 3  /* park small blocks, merge them in batches */
+
+#ifndef MM_FIT
+#define MM_FIT FIT_FIRST
+#endif
+#ifndef MM_WILDERNESS
+#define MM_WILDERNESS WILDERNESS_ANY
+#endif
+#ifndef MM_SPLIT_MIN
+#define MM_SPLIT_MIN MIN_BLOCK
+#endif
+#ifndef MM_PLACE_HIGH
+#define MM_PLACE_HIGH 256
+#endif
+#ifndef MM_COALESCE
+#define MM_COALESCE COALESCE_IMMEDIATE
+#endif
+#ifndef MM_CHUNKSIZE
+#define MM_CHUNKSIZE (1<<12)
+#endif
+#define CHUNKSIZE MM_CHUNKSIZE
+#ifndef MM_GROW_MAX
+#define MM_GROW_MAX (16 * MM_CHUNKSIZE)
+#endif
+
+#if MM_FIT != FIT_FIRST && MM_FIT != FIT_BEST && MM_FIT != FIT_NEXT
+#error "MM_FIT must be FIT_FIRST, FIT_BEST or FIT_NEXT"
+#endif
+#if MM_WILDERNESS != WILDERNESS_ANY && MM_WILDERNESS != WILDERNESS_LAST
+#error "MM_WILDERNESS must be WILDERNESS_ANY or WILDERNESS_LAST"
+#endif
+#if MM_SPLIT_MIN < MIN_BLOCK
+#error "MM_SPLIT_MIN must be at least MIN_BLOCK"
+#endif
+#if MM_COALESCE != COALESCE_IMMEDIATE && MM_COALESCE != COALESCE_NEVER \
+    && MM_COALESCE != COALESCE_DEFERRED
+#error "MM_COALESCE must be COALESCE_IMMEDIATE, COALESCE_NEVER or COALESCE_DEFERRED"
+#endif
+#if MM_CHUNKSIZE % ALIGNMENT != 0 || MM_CHUNKSIZE < MIN_BLOCK
+#error "MM_CHUNKSIZE must be a multiple of ALIGNMENT"
+#endif
+#if MM_GROW_MAX < MM_CHUNKSIZE
+#error "MM_GROW_MAX must be at least MM_CHUNKSIZE"
+#endif
 
 #define MAX(x, y) ((x) > (y)? (x) : (y))
+#define MIN(x, y) ((x) < (y)? (x) : (y))
+
+/*
+ * Headers and footers are 4 bytes even in 64-bit builds: the heap is far
+ * smaller than 4 GB, so a 32-bit size field holds any block size. Free
+ * list and tree links are 4-byte offsets from heap_base for the same
+ * reason, which keeps the minimum block at 16 bytes on any word size.
+ */
 
-/* pack a size and allocated bit into a word */
-#define PACK(size, alloc) ((size) | (alloc))
+/* pack a size, prev-allocated bit and allocated bit into a word */
+#define PACK(size, prev_alloc, alloc) \
+    ((size) | ((prev_alloc) ? 0x2 : 0) | ((alloc) ? 0x1 : 0))
 
 /* read and write a word at address p */
 #define GET(p) (*(unsigned int *)(p))
@@ -61,181 +155,2116 @@ team_t team = {
 /* read the size and allocated fields from address p */
 #define GET_SIZE(p) (GET(p) & ~0x7)
 #define GET_ALLOC(p) (GET(p) & 0x1)
+#define GET_PREV_ALLOC(p) (GET(p) & 0x2)
 
-/* given block pointer bp, compute address of its header and footer */
+/* set and clear the prev-allocated bit of the header at address p */
+#define SET_PREV_ALLOC(p) PUT(p, GET(p) | 0x2)
+#define CLEAR_PREV_ALLOC(p) PUT(p, GET(p) & ~0x2)
+
+/* given block pointer bp, compute address of its header and footer
+   (only free blocks have a footer) */
 #define HDRP(bp) ((char *)(bp) - WSIZE)
 #define FTRP(bp) ((char *)(bp) + GET_SIZE(HDRP(bp)) - DSIZE)
 
-/* given block pointer bp, compute address of next and previous blocks */
+/* given block pointer bp, compute address of next and previous blocks
+   (PREV_BLKP is only valid when the previous block is free) */
 #define NEXT_BLKP(bp) ((char *)(bp) + GET_SIZE(((char *)(bp) - WSIZE)))
 #define PREV_BLKP(bp) ((char *)(bp) - GET_SIZE(((char *)(bp) - DSIZE)))
 
+/* is bp the last block before the epilogue, and one that find_fit
+   should pass over? */
+#define IS_TOP(bp) (GET_SIZE(HDRP(NEXT_BLKP(bp))) == 0)
+#if MM_WILDERNESS == WILDERNESS_LAST
+#define AVOID_TOP(bp) IS_TOP(bp)
+#else
+#define AVOID_TOP(bp) 0
+#endif
+
+/* convert between block pointers and heap offsets (offset 0 is NULL) */
+#define TO_OFF(bp) ((bp) ? (unsigned int)((char *)(bp) - heap_base) : 0)
+#define FROM_OFF(off) ((off) ? heap_base + (off) : NULL)
+
+/* given free block pointer bp, read and write its list links */
+#define NEXT_FREE(bp) FROM_OFF(GET(bp))
+#define PREV_FREE(bp) FROM_OFF(GET((char *)(bp) + WSIZE))
+#define SET_NEXT_FREE(bp, np) PUT(bp, TO_OFF(np))
+#define SET_PREV_FREE(bp, pp) PUT((char *)(bp) + WSIZE, TO_OFF(pp))
+
+/* given tree node bp, read and write its links and colour */
+#define RED 1
+#define BLACK 0
+#define LEFT(bp) FROM_OFF(GET(bp))
+#define RIGHT(bp) FROM_OFF(GET((char *)(bp) + WSIZE))
+#define PARENT(bp) FROM_OFF(GET((char *)(bp) + 2*WSIZE))
+#define COLOR(bp) GET((char *)(bp) + 3*WSIZE)
+#define SET_LEFT(bp, p) PUT(bp, TO_OFF(p))
+#define SET_RIGHT(bp, p) PUT((char *)(bp) + WSIZE, TO_OFF(p))
+#define SET_PARENT(bp, p) PUT((char *)(bp) + 2*WSIZE, TO_OFF(p))
+#define SET_COLOR(bp, c) PUT((char *)(bp) + 3*WSIZE, c)
+#define IS_RED(bp) ((bp) != NULL && COLOR(bp) == RED)
+
+/* tree order: by block size, then by address */
+#define KEY_LESS(x, y) \
+    (GET_SIZE(HDRP(x)) < GET_SIZE(HDRP(y)) || \
+     (GET_SIZE(HDRP(x)) == GET_SIZE(HDRP(y)) && (char *)(x) < (char *)(y)))
+
+/*
+ * A slab run is a RUN_SIZE allocated block, aligned on a RUN_SIZE
+ * boundary relative to heap_base, that is carved into equal slots. Its
+ * run_t descriptor keeps a stack of recycled slots and a bump offset for
+ * slots never handed out. run_map tells mm_free whether a pointer lies
+ * in a run, and a run whose slots are all free goes back to the heap
+ * unless it is the last one of its size.
+ */
+
+/* slab constants */
+#define SLAB_MAX 128                       /* largest slab request */
+#define NUM_SLABS (SLAB_MAX / ALIGNMENT)   /* one slot size per class */
+#define RUN_SHIFT 12
+#define RUN_SIZE (1<<RUN_SHIFT)            /* bytes per slab run */
+#define RUN_SLOTS ALIGN(sizeof(run_t))     /* slot area offset in a run */
+#define RUN_MAP_SIZE (MAX_HEAP / RUN_SIZE)
+
+/* descriptor at the start of each slab run (links are heap offsets) */
+typedef struct {
+    unsigned int next;       /* next run of this size with free slots */
+    unsigned int prev;       /* previous run of this size with free slots */
+    unsigned int slot_size;  /* bytes per slot */
+    unsigned int nslots;     /* number of slots in the run */
+    unsigned int nfree;      /* number of free slots */
+    unsigned int free_slots; /* top of the recycled slot stack */
+    unsigned int bump;       /* first slot that was never handed out */
+} run_t;
+
+/* given an address p in the heap, compute its run page and descriptor */
+#define RUN_INDEX(p) ((unsigned int)(((char *)(p) - heap_base) >> RUN_SHIFT))
+#define RUN_OF(p) ((run_t *)(heap_base + \
+                             ((size_t)RUN_INDEX(p) << RUN_SHIFT) + ALIGNMENT))
+
+/* test, set and clear the slab flag of the run page holding p (one
+   byte per page, so the lock-free test never shares a byte with a
+   concurrent update); with 16-byte alignment the heap block just
+   before a run can have its payload on the run page's first byte, so
+   only addresses in the slot area count as slots */
+#define IS_SLAB(p) (run_map[RUN_INDEX(p)] && \
+                    (char *)(p) >= (char *)RUN_OF(p) + RUN_SLOTS)
+#define SET_SLAB(p) (run_map[RUN_INDEX(p)] = 1)
+#define CLEAR_SLAB(p) (run_map[RUN_INDEX(p)] = 0)
+
+/* the slot size class of a request, and of the slot p */
+#define SLAB_CLASS(size) (((size) - 1) / ALIGNMENT)
+#define SLOT_CLASS(p) (RUN_OF(p)->slot_size / ALIGNMENT - 1)
+
+/* with COALESCE_DEFERRED, freed heap blocks of QUICK_MIN to QUICK_MAX
+   bytes wait unmerged, still marked allocated, on one LIFO quick list
+   per block size, linked through their first payload word */
+#define QUICK_MIN ALIGN(SLAB_MAX + 1 + WSIZE) /* smallest heap request */
+#define QUICK_MAX 1024
+#define NUM_QUICK ((QUICK_MAX - QUICK_MIN) / ALIGNMENT + 1)
+#define QUICK_BYTES (64 * 1024) /* parked bytes that force a merge */
+#define IS_QUICK(size) ((size) >= QUICK_MIN && (size) <= QUICK_MAX)
+#define QUICK_BIN(size) (((size) - QUICK_MIN) / ALIGNMENT)
+
+/* most arenas mm_init_arenas accepts (one memlib region each) */
+#define MAX_ARENAS MEM_MAX_REGIONS
+
+/* an independent heap with its own region, free lists and slab runs */
+typedef struct {
+    char *heap_listp;                 /* prologue block of the arena */
+    char *seg_lists[NUM_CLASSES];     /* heads of the free lists */
+#if MM_FIT == FIT_NEXT
+    char *rovers[NUM_CLASSES];        /* where each list's next search starts */
+#endif
+    char *tree_root;                  /* root of the large-block tree */
+    run_t *slab_runs[NUM_SLABS];      /* runs with free slots, per size */
+    int region;                       /* memlib region holding the arena */
+    size_t grow;                      /* bytes the next extension adds */
+    unsigned long idle_fits;          /* fits since the last extension */
+    size_t reserve;                   /* top bytes trimming leaves, see
+                                         mm_reserve */
+#if MM_COALESCE == COALESCE_DEFERRED
+    char *quick[NUM_QUICK];           /* parked blocks, per size */
+    size_t quick_bytes;               /* bytes parked on them */
+#endif
+#ifdef MM_THREADS
+    pthread_mutex_t lock;             /* guards everything above */
+#endif
+} arena_t;
+
+/* given an address p in the heap, find the arena whose region holds it */
+#define ARENA_OF(p) (&arenas[((char *)(p) - heap_base) / arena_span])
+
+/* a request that arena_alloc tries in one arena after another, and the
+   function that carves it from an arena whose lock is held */
+typedef struct {
+    size_t size;       /* bytes per block */
+    size_t alignment;  /* payload alignment, for mm_memalign */
+    size_t n;          /* number of blocks, for mm_malloc_batch */
+    void **out;        /* where mm_malloc_batch stores them */
+} request_t;
+typedef void *(*arena_fn)(arena_t *a, request_t *req);
+
+/* huge blocks live in mappings of their own, outside the heap, so they
+   never fragment a region or pin its break: the first HUGE_PAD bytes of
+   the mapping hold its length, and the payload follows */
+#define HUGE_PAD ALIGN(sizeof(size_t))
+#define IS_HUGE(p) ((char *)(p) < heap_base || \
+                    (char *)(p) >= heap_base + MAX_HEAP)
+#define HUGE_BASE(p) ((char *)(p) - HUGE_PAD)
+#define HUGE_LEN(p) (*(size_t *)HUGE_BASE(p))
+#define IS_HUGE_REQUEST(size) \
+    (mmap_threshold >= 0 && (size) >= (size_t)mmap_threshold)
+
+#ifdef MM_THREADS
+/* Each thread caches slab slots per slot size, so most small
+   malloc/free pairs take no lock at all. Only refills and flushes of
+   the cache, larger blocks and mem_sbrk are serialized, by the arena
+   locks. mm_init must still run while no other thread is allocating. */
+
+/* per-thread slot cache constants */
+#define TCACHE_MAX 64   /* most slots a thread caches per slot size */
+#define TCACHE_FILL 16  /* slots moved per refill or flush */
+
+/* a thread's cache of slab slots, linked through the slots themselves */
+typedef struct {
+    unsigned int gen;                  /* heap_gen the slots belong to */
+    int registered;                    /* is the exit destructor armed? */
+    char *slots[NUM_SLABS];            /* top of each slot stack */
+    unsigned int count[NUM_SLABS];     /* number of slots in each stack */
+} tcache_t;
+
+#define LOCK(a) pthread_mutex_lock(&(a)->lock)
+#define UNLOCK(a) pthread_mutex_unlock(&(a)->lock)
+#define THREAD_LOCAL __thread
+#else
+#define LOCK(a)
+#define UNLOCK(a)
+#define THREAD_LOCAL
+#define cache_free(ptr, class) slab_free(ARENA_OF(ptr), ptr)
+#endif
+
+#ifdef MM_STATS
+/* statistics hooks for mm_stats, compiled to nothing without MM_STATS;
+   counters are shared between threads */
+#ifdef MM_THREADS
+#define STAT_ADD(field, n) \
+    __atomic_fetch_add(&stats.field, (n), __ATOMIC_RELAXED)
+#else
+#define STAT_ADD(field, n) (stats.field += (n))
+#endif
+#define STAT_HIST(field, v) STAT_ADD(field[log2_bin(v)], 1)
+#define STAT_STEP() (fit_steps++)
+#else
+#define STAT_ADD(field, n)
+#define STAT_HIST(field, v)
+#define STAT_STEP()
+#endif
+
 /* global variables */
-static char *heap_listp;
+static char *heap_base;               /* first byte of the heap */
+static arena_t arenas[MAX_ARENAS];
+static int num_arenas;                /* arenas set up by mm_init_arenas */
+static size_t arena_span;             /* bytes of heap reserved per arena */
+static unsigned int next_arena;       /* round-robin arena assignment */
+static unsigned int heap_gen;         /* bumped by every mm_init */
+static unsigned char run_map[RUN_MAP_SIZE]; /* slab flag per run page */
+static long trim_threshold = TRIM_THRESHOLD; /* see mm_setopt */
+static long mmap_threshold = MMAP_THRESHOLD; /* see mm_setopt */
+#ifdef MM_STATS
+static mm_stats_t stats;              /* see mm_stats */
+static THREAD_LOCAL unsigned long fit_steps; /* blocks visited by a search */
+#endif
+
+/* the calling thread's arena, valid while my_gen matches heap_gen */
+static THREAD_LOCAL arena_t *my_arena;
+static THREAD_LOCAL unsigned int my_gen;
+
+#ifdef MM_THREADS
+static pthread_key_t tcache_key;      /* flushes a cache on thread exit */
+static pthread_once_t tcache_once = PTHREAD_ONCE_INIT;
+static __thread tcache_t tcache;
+#endif
 
 /* prototypes for helper methods */
-static void *coalesce(void *ptr);
-static void *extend_heap(size_t words);
-static void *find_fit(size_t asize);
-static void place(void *ptr, size_t asize);
+static void *coalesce(arena_t *a, void *ptr);
+static void *extend_heap(arena_t *a, size_t words);
+static void *grow_heap(arena_t *a, size_t asize);
+static void *top_block(arena_t *a);
+static void *find_fit(arena_t *a, size_t asize);
+static void place(arena_t *a, void *ptr, size_t asize);
+#if MM_PLACE_HIGH > 0
+static void *place_high(arena_t *a, void *ptr, size_t asize);
+#endif
+static int size_class(size_t size);
+static void insert_free(arena_t *a, void *ptr);
+static void remove_free(arena_t *a, void *ptr);
+static void rotate_left(arena_t *a, char *x);
+static void rotate_right(arena_t *a, char *x);
+static void transplant(arena_t *a, char *u, char *v);
+static void tree_insert(arena_t *a, char *z);
+static void tree_remove(arena_t *a, char *z);
+static void tree_remove_fixup(arena_t *a, char *x, char *xp);
+static void *tree_best_fit(arena_t *a, size_t asize);
+#if MM_FIT == FIT_BEST
+static void *list_best_fit(char *ptr, size_t asize);
+#endif
+#if MM_FIT == FIT_NEXT
+static void *list_next_fit(arena_t *a, int class, size_t asize);
+#endif
+#if MM_WILDERNESS == WILDERNESS_LAST
+static char *tree_next(char *x);
+#endif
+static void free_block(arena_t *a, void *ptr);
+static void release_block(arena_t *a, void *ptr);
+#if MM_COALESCE == COALESCE_DEFERRED
+static void quick_flush(arena_t *a);
+#endif
+static void trim_heap(arena_t *a, void *ptr);
+static size_t adjust_size(size_t size);
+static void shrink_block(arena_t *a, void *ptr, size_t asize);
+static void *split_lead(arena_t *a, void *ptr, size_t lead);
+static run_t *slab_new_run(arena_t *a, int class);
+static void *slab_alloc(arena_t *a, int class);
+static void slab_free(arena_t *a, void *ptr);
+static void slab_link(arena_t *a, run_t *run, int class);
+static void slab_unlink(arena_t *a, run_t *run, int class);
+static void *heap_malloc(arena_t *a, size_t size);
+static void *heap_memalign(arena_t *a, size_t alignment, size_t size);
+static void *heap_calloc(arena_t *a, size_t size);
+static int heap_malloc_batch(arena_t *a, size_t asize, size_t n, void **out);
+static int ptr_cmp(const void *x, const void *y);
+#ifndef NDEBUG
+static int size_hint_ok(void *ptr, size_t size);
+#endif
+#ifdef MM_STATS
+static int log2_bin(size_t v);
+#endif
+static size_t huge_len(size_t size);
+static void *huge_alloc(size_t size);
+static void *huge_realloc(void *ptr, size_t size);
+static arena_t *thread_arena(void);
+static void *arena_alloc(arena_fn fn, request_t *req);
+static void *try_malloc(arena_t *a, request_t *req);
+static void *try_calloc(arena_t *a, request_t *req);
+static void *try_memalign(arena_t *a, request_t *req);
+static void *try_batch(arena_t *a, request_t *req);
+static int arena_init(arena_t *a);
+static void *cache_alloc(int class);
+#ifdef MM_THREADS
+static void cache_free(void *ptr, int class);
+static void cache_open(void);
+static void cache_flush(int class, unsigned int n);
+static void cache_exit(void *arg);
+static void cache_make_key(void);
+#endif
 
-static void *extend_heap(size_t words)
+static void *extend_heap(arena_t *a, size_t words)
 {
     char *ptr;
     size_t size;
+    size_t prev_alloc;
     
-    /* allocate even number of words to maintain alignment */
-    size = (words % 2) ? (words + 1) * WSIZE : words * WSIZE;
-    if ((long)(ptr = mem_sbrk(size)) == -1) {
+    /* allocate a multiple of the alignment to maintain it */
+    size = ALIGN(words * WSIZE);
+    if ((long)(ptr = mem_sbrk_region(a->region, size)) == -1) {
         return NULL;
     }
+    STAT_ADD(extends, 1);
+    STAT_ADD(extend_bytes, size);
+    STAT_HIST(heap_growth, size);
     
     /* initialize  free block header/footer and epilogue header */
-    PUT(HDRP(ptr), PACK(size, 0)); /* free block header */
-    PUT(FTRP(ptr), PACK(size, 0)); /* free block footer */
-    PUT(HDRP(NEXT_BLKP(ptr)), PACK(0, 1)); /* new epilogue header */
+    prev_alloc = GET_PREV_ALLOC(HDRP(ptr)); /* from the old epilogue */
+    PUT(HDRP(ptr), PACK(size, prev_alloc, 0)); /* free block header */
+    PUT(FTRP(ptr), PACK(size, prev_alloc, 0)); /* free block footer */
+    PUT(HDRP(NEXT_BLKP(ptr)), PACK(0, 0, 1)); /* new epilogue header */
     
     /* coalesce if the previous block was free */
-    return coalesce(ptr);
+    return coalesce(a, ptr);
+}
+
+/*
+ * top_block - Return the free block at the top of the arena, or NULL if
+ *     the last block is allocated.
+ */
+static void *top_block(arena_t *a)
+{
+    char *brk = (char *)mem_region_hi(a->region) + 1;
+    
+    if (GET_PREV_ALLOC(HDRP(brk))) {
+        return NULL;
+    }
+    return PREV_BLKP(brk);
 }
 
-static void *find_fit(size_t asize)
+/*
+ * grow_heap - Extend the arena until the free block at its top holds
+ *     asize bytes, and return that block, or NULL if the region is full.
+ *     Back-to-back extensions double the growth step up to MM_GROW_MAX,
+ *     and every GROW_IDLE fits in between halve it again. When a full
+ *     step no longer fits in the region, only the missing bytes are
+ *     asked for and the step starts over from CHUNKSIZE.
+ */
+static void *grow_heap(arena_t *a, size_t asize)
 {
-    /* first-fit search */
+    char *top = top_block(a);
+    size_t missing = asize;
+    size_t step;
+    unsigned long idle;
     void *ptr;
-    for (ptr = heap_listp; GET_SIZE(HDRP(ptr)) > 0; ptr = NEXT_BLKP(ptr)) {
-        if (!GET_ALLOC(HDRP(ptr)) && (asize <= GET_SIZE(HDRP(ptr)))) {
+    
+    /* only what the free tail is short of needs new memory */
+    if (top != NULL) {
+        missing -= GET_SIZE(HDRP(top));
+    }
+    for (idle = a->idle_fits; idle >= GROW_IDLE && a->grow > CHUNKSIZE;
+         idle -= GROW_IDLE) {
+        a->grow /= 2;
+    }
+    a->idle_fits = 0;
+    
+    /* a request beyond the step gets just what it needs, and does not
+       count towards a burst */
+    step = MAX(missing, a->grow);
+    if (missing < a->grow) {
+        a->grow = MIN(2 * a->grow, MM_GROW_MAX);
+    }
+    if ((ptr = extend_heap(a, step/WSIZE)) == NULL && step > missing) {
+        a->grow = CHUNKSIZE;
+        ptr = extend_heap(a, MAX(missing, MIN_BLOCK)/WSIZE);
+    }
+    return ptr;
+}
+
+static int size_class(size_t size)
+{
+    int class = 0;
+    
+    /* class i holds sizes in [2^(i+4), 2^(i+5)) */
+    size >>= 5;
+    while (size > 0 && class < NUM_CLASSES - 1) {
+        size >>= 1;
+        class++;
+    }
+    return class;
+}
+
+static void insert_free(arena_t *a, void *ptr)
+{
+    int class;
+    char *head;
+    
+    if (GET_SIZE(HDRP(ptr)) >= TREE_MIN) {
+        tree_insert(a, ptr);
+        return;
+    }
+    class = size_class(GET_SIZE(HDRP(ptr)));
+    head = a->seg_lists[class];
+    
+    /* LIFO insertion at the head of the list */
+    SET_NEXT_FREE(ptr, head);
+    SET_PREV_FREE(ptr, NULL);
+    if (head != NULL) {
+        SET_PREV_FREE(head, ptr);
+    }
+    a->seg_lists[class] = ptr;
+}
+
+static void remove_free(arena_t *a, void *ptr)
+{
+    char *next, *prev;
+    int class;
+    
+    if (GET_SIZE(HDRP(ptr)) >= TREE_MIN) {
+        tree_remove(a, ptr);
+        return;
+    }
+    next = NEXT_FREE(ptr);
+    prev = PREV_FREE(ptr);
+    class = size_class(GET_SIZE(HDRP(ptr)));
+    
+#if MM_FIT == FIT_NEXT
+    /* a rover on a block that place or coalesce takes off the list moves
+       on to the block after it */
+    if (a->rovers[class] == ptr) {
+        a->rovers[class] = next;
+    }
+#endif
+    if (prev != NULL) {
+        SET_NEXT_FREE(prev, next);
+    } else {
+        a->seg_lists[class] = next;
+    }
+    if (next != NULL) {
+        SET_PREV_FREE(next, prev);
+    }
+}
+
+static void *find_fit(arena_t *a, size_t asize)
+{
+    int class;
+    char *ptr;
+    
+    if (asize >= TREE_MIN) {
+        ptr = tree_best_fit(a, asize);
+    } else {
+        class = size_class(asize);
+#if MM_FIT == FIT_FIRST
+        /* first fit within the request's own class */
+        for (ptr = a->seg_lists[class]; ptr != NULL; ptr = NEXT_FREE(ptr)) {
+            STAT_STEP();
+            if (asize <= GET_SIZE(HDRP(ptr)) && !AVOID_TOP(ptr)) {
+                return ptr;
+            }
+        }
+#elif MM_FIT == FIT_NEXT
+        if ((ptr = list_next_fit(a, class, asize)) != NULL) {
+            return ptr;
+        }
+#endif
+#if MM_FIT == FIT_BEST
+        /* best fit within the request's own class, and otherwise within
+           the first larger class that has a block, all of whose blocks
+           fit */
+        for (; class < NUM_CLASSES; class++) {
+            if ((ptr = list_best_fit(a->seg_lists[class], asize)) != NULL) {
+                return ptr;
+            }
+        }
+#else
+        /* every block in a larger class, or in the tree, fits */
+        for (class++; class < NUM_CLASSES; class++) {
+            STAT_STEP();
+            ptr = a->seg_lists[class];
+            if (ptr != NULL && AVOID_TOP(ptr)) {
+                ptr = NEXT_FREE(ptr);
+            }
+            if (ptr != NULL) {
+                return ptr;
+            }
+        }
+#endif
+        ptr = tree_best_fit(a, asize);
+    }
+#if MM_WILDERNESS == WILDERNESS_LAST
+    
+    /* the top block is the highest of its size, so the next larger tree
+       block is the best fit that leaves it alone */
+    if (ptr != NULL && IS_TOP(ptr)) {
+        ptr = tree_next(ptr);
+    }
+    if (ptr == NULL && (ptr = top_block(a)) != NULL &&
+        GET_SIZE(HDRP(ptr)) < asize) {
+        ptr = NULL;
+    }
+#endif
+    return ptr;
+}
+
+#if MM_FIT == FIT_BEST
+/*
+ * list_best_fit - Return the smallest block of at least asize bytes on
+ *     the free list starting at ptr, or NULL if none fits.
+ */
+static void *list_best_fit(char *ptr, size_t asize)
+{
+    char *best = NULL;
+    size_t size;
+    
+    for (; ptr != NULL; ptr = NEXT_FREE(ptr)) {
+        STAT_STEP();
+        size = GET_SIZE(HDRP(ptr));
+        if (size >= asize && (best == NULL || size < GET_SIZE(HDRP(best)))
+            && !AVOID_TOP(ptr)) {
+            best = ptr;
+            if (size == asize) {
+                break;
+            }
+        }
+    }
+    return best;
+}
+#endif
+
+#if MM_FIT == FIT_NEXT
+/*
+ * list_next_fit - Return the first block of at least asize bytes on the
+ *     free list of class, searching from the list's rover round to where
+ *     it started, and leave the rover on that block. NULL if none fits.
+ */
+static void *list_next_fit(arena_t *a, int class, size_t asize)
+{
+    char *start = a->rovers[class];
+    char *ptr = start;
+    
+    if (ptr == NULL) {
+        ptr = start = a->seg_lists[class];
+    }
+    while (ptr != NULL) {
+        STAT_STEP();
+        if (asize <= GET_SIZE(HDRP(ptr)) && !AVOID_TOP(ptr)) {
+            a->rovers[class] = ptr;
             return ptr;
         }
+        if ((ptr = NEXT_FREE(ptr)) == NULL) {
+            ptr = a->seg_lists[class];
+        }
+        if (ptr == start) {
+            break;
+        }
+    }
+    return NULL;
+}
+#endif
+
+static void rotate_left(arena_t *a, char *x)
+{
+    char *y = RIGHT(x);
+    
+    SET_RIGHT(x, LEFT(y));
+    if (LEFT(y) != NULL) {
+        SET_PARENT(LEFT(y), x);
+    }
+    transplant(a, x, y);
+    SET_LEFT(y, x);
+    SET_PARENT(x, y);
+}
+
+static void rotate_right(arena_t *a, char *x)
+{
+    char *y = LEFT(x);
+    
+    SET_LEFT(x, RIGHT(y));
+    if (RIGHT(y) != NULL) {
+        SET_PARENT(RIGHT(y), x);
+    }
+    transplant(a, x, y);
+    SET_RIGHT(y, x);
+    SET_PARENT(x, y);
+}
+
+/*
+ * transplant - Hang the subtree v (possibly empty) where u hangs now.
+ */
+static void transplant(arena_t *a, char *u, char *v)
+{
+    char *p = PARENT(u);
+    
+    if (p == NULL) {
+        a->tree_root = v;
+    } else if (u == LEFT(p)) {
+        SET_LEFT(p, v);
+    } else {
+        SET_RIGHT(p, v);
+    }
+    if (v != NULL) {
+        SET_PARENT(v, p);
+    }
+}
+
+static void tree_insert(arena_t *a, char *z)
+{
+    char *x = a->tree_root;
+    char *p = NULL;
+    char *g, *u;
+    
+    /* ordinary binary search tree insertion as a red leaf */
+    while (x != NULL) {
+        p = x;
+        x = KEY_LESS(z, x) ? LEFT(x) : RIGHT(x);
+    }
+    SET_LEFT(z, NULL);
+    SET_RIGHT(z, NULL);
+    SET_PARENT(z, p);
+    SET_COLOR(z, RED);
+    if (p == NULL) {
+        a->tree_root = z;
+    } else if (KEY_LESS(z, p)) {
+        SET_LEFT(p, z);
+    } else {
+        SET_RIGHT(p, z);
+    }
+    
+    /* restore the red-black properties on the way up */
+    while (IS_RED(p = PARENT(z))) {
+        g = PARENT(p);
+        if (p == LEFT(g)) {
+            u = RIGHT(g);
+            if (IS_RED(u)) {
+                SET_COLOR(p, BLACK);
+                SET_COLOR(u, BLACK);
+                SET_COLOR(g, RED);
+                z = g;
+            } else {
+                if (z == RIGHT(p)) {
+                    z = p;
+                    rotate_left(a, z);
+                    p = PARENT(z);
+                }
+                SET_COLOR(p, BLACK);
+                SET_COLOR(g, RED);
+                rotate_right(a, g);
+            }
+        } else {
+            u = LEFT(g);
+            if (IS_RED(u)) {
+                SET_COLOR(p, BLACK);
+                SET_COLOR(u, BLACK);
+                SET_COLOR(g, RED);
+                z = g;
+            } else {
+                if (z == LEFT(p)) {
+                    z = p;
+                    rotate_right(a, z);
+                    p = PARENT(z);
+                }
+                SET_COLOR(p, BLACK);
+                SET_COLOR(g, RED);
+                rotate_left(a, g);
+            }
+        }
+    }
+    SET_COLOR(a->tree_root, BLACK);
+}
+
+static void tree_remove(arena_t *a, char *z)
+{
+    char *y = z;
+    char *x, *xp;
+    int y_color = COLOR(y);
+    
+    if (LEFT(z) == NULL) {
+        x = RIGHT(z);
+        xp = PARENT(z);
+        transplant(a, z, x);
+    } else if (RIGHT(z) == NULL) {
+        x = LEFT(z);
+        xp = PARENT(z);
+        transplant(a, z, x);
+    } else {
+        /* replace z by its successor y */
+        for (y = RIGHT(z); LEFT(y) != NULL; y = LEFT(y))
+            ;
+        y_color = COLOR(y);
+        x = RIGHT(y);
+        if (PARENT(y) == z) {
+            xp = y;
+        } else {
+            xp = PARENT(y);
+            transplant(a, y, x);
+            SET_RIGHT(y, RIGHT(z));
+            SET_PARENT(RIGHT(y), y);
+        }
+        transplant(a, z, y);
+        SET_LEFT(y, LEFT(z));
+        SET_PARENT(LEFT(y), y);
+        SET_COLOR(y, COLOR(z));
+    }
+    if (y_color == BLACK) {
+        tree_remove_fixup(a, x, xp);
+    }
+}
+
+/*
+ * tree_remove_fixup - Repair the black height after a removal left the
+ *     subtree x (possibly empty) under parent xp one black node short.
+ */
+static void tree_remove_fixup(arena_t *a, char *x, char *xp)
+{
+    char *w;
+    
+    while (x != a->tree_root && !IS_RED(x)) {
+        if (x == LEFT(xp)) {
+            w = RIGHT(xp);
+            if (IS_RED(w)) {
+                SET_COLOR(w, BLACK);
+                SET_COLOR(xp, RED);
+                rotate_left(a, xp);
+                w = RIGHT(xp);
+            }
+            if (!IS_RED(LEFT(w)) && !IS_RED(RIGHT(w))) {
+                SET_COLOR(w, RED);
+                x = xp;
+                xp = PARENT(x);
+            } else {
+                if (!IS_RED(RIGHT(w))) {
+                    SET_COLOR(LEFT(w), BLACK);
+                    SET_COLOR(w, RED);
+                    rotate_right(a, w);
+                    w = RIGHT(xp);
+                }
+                SET_COLOR(w, COLOR(xp));
+                SET_COLOR(xp, BLACK);
+                SET_COLOR(RIGHT(w), BLACK);
+                rotate_left(a, xp);
+                x = a->tree_root;
+            }
+        } else {
+            w = LEFT(xp);
+            if (IS_RED(w)) {
+                SET_COLOR(w, BLACK);
+                SET_COLOR(xp, RED);
+                rotate_right(a, xp);
+                w = LEFT(xp);
+            }
+            if (!IS_RED(LEFT(w)) && !IS_RED(RIGHT(w))) {
+                SET_COLOR(w, RED);
+                x = xp;
+                xp = PARENT(x);
+            } else {
+                if (!IS_RED(LEFT(w))) {
+                    SET_COLOR(RIGHT(w), BLACK);
+                    SET_COLOR(w, RED);
+                    rotate_left(a, w);
+                    w = LEFT(xp);
+                }
+                SET_COLOR(w, COLOR(xp));
+                SET_COLOR(xp, BLACK);
+                SET_COLOR(LEFT(w), BLACK);
+                rotate_right(a, xp);
+                x = a->tree_root;
+            }
+        }
+    }
+    if (x != NULL) {
+        SET_COLOR(x, BLACK);
+    }
+}
+
+/*
+ * tree_best_fit - Return the smallest tree block of at least asize
+ *     bytes (the lowest-addressed one among equals), or NULL.
+ */
+static void *tree_best_fit(arena_t *a, size_t asize)
+{
+    char *x = a->tree_root;
+    char *best = NULL;
+    
+    while (x != NULL) {
+        STAT_STEP();
+        if (GET_SIZE(HDRP(x)) >= asize) {
+            best = x;
+            x = LEFT(x);
+        } else {
+            x = RIGHT(x);
+        }
+    }
+    return best;
+}
+
+#if MM_WILDERNESS == WILDERNESS_LAST
+/*
+ * tree_next - Return the tree block that follows x in size and address
+ *     order, or NULL if x is the largest.
+ */
+static char *tree_next(char *x)
+{
+    char *y;
+    
+    if (RIGHT(x) != NULL) {
+        for (x = RIGHT(x); LEFT(x) != NULL; x = LEFT(x))
+            ;
+        return x;
+    }
+    for (y = PARENT(x); y != NULL && x == RIGHT(y); y = PARENT(y)) {
+        x = y;
     }
-    return NULL; /* no fit */
+    return y;
 }
+#endif
 
-static void place(void *ptr, size_t asize)
+static void place(arena_t *a, void *ptr, size_t asize)
 {
     size_t csize = GET_SIZE(HDRP(ptr));
+    size_t prev_alloc = GET_PREV_ALLOC(HDRP(ptr));
     
-    if ((csize - asize) >= (2 * DSIZE)) {
-        PUT(HDRP(ptr), PACK(asize, 1));
-        PUT(FTRP(ptr), PACK(asize, 1));
+    remove_free(a, ptr);
+    if ((csize - asize) >= MM_SPLIT_MIN) {
+        STAT_ADD(splits, 1);
+        STAT_HIST(split_rem, csize - asize);
+        PUT(HDRP(ptr), PACK(asize, prev_alloc, 1));
         ptr = NEXT_BLKP(ptr);
-        PUT(HDRP(ptr), PACK(csize - asize, 1));
-        PUT(FTRP(ptr), PACK(csize - asize, 1));
+        PUT(HDRP(ptr), PACK(csize - asize, 1, 0));
+        PUT(FTRP(ptr), PACK(csize - asize, 1, 0));
+        insert_free(a, ptr);
     } else {
-        PUT(HDRP(ptr), PACK(csize, 1));
-        PUT(FTRP(ptr), PACK(csize, 1));
+        STAT_ADD(split_waste, csize - asize);
+        PUT(HDRP(ptr), PACK(csize, prev_alloc, 1));
+        SET_PREV_ALLOC(HDRP(NEXT_BLKP(ptr)));
     }
 }
 
-static void *coalesce(void *ptr)
+#if MM_PLACE_HIGH > 0
+/*
+ * place_high - Allocate the last asize bytes of the free block ptr and
+ *     return them, leaving the front of the block free. The top block,
+ *     and a block whose front would be too small to split off, are
+ *     placed as usual.
+ */
+static void *place_high(arena_t *a, void *ptr, size_t asize)
+{
+    size_t csize = GET_SIZE(HDRP(ptr));
+    size_t prev_alloc = GET_PREV_ALLOC(HDRP(ptr));
+    char *bp;
+    
+    /* the top block keeps its free end next to the break */
+    if ((csize - asize) < MM_SPLIT_MIN || IS_TOP(ptr)) {
+        place(a, ptr, asize);
+        return ptr;
+    }
+    STAT_ADD(splits, 1);
+    STAT_HIST(split_rem, csize - asize);
+    remove_free(a, ptr);
+    PUT(HDRP(ptr), PACK(csize - asize, prev_alloc, 0));
+    PUT(FTRP(ptr), PACK(csize - asize, prev_alloc, 0));
+    insert_free(a, ptr);
+    bp = NEXT_BLKP(ptr);
+    PUT(HDRP(bp), PACK(asize, 0, 1));
+    SET_PREV_ALLOC(HDRP(NEXT_BLKP(bp)));
+    return bp;
+}
+#endif
+
+static void *coalesce(arena_t *a, void *ptr)
 {
-    size_t prev_alloc = GET_ALLOC(FTRP(PREV_BLKP(ptr)));
+    size_t prev_alloc = GET_PREV_ALLOC(HDRP(ptr));
     size_t next_alloc = GET_ALLOC(HDRP(NEXT_BLKP(ptr)));
     size_t size = GET_SIZE(HDRP(ptr));
     
+    STAT_ADD(coalesce[(!prev_alloc << 1) | !next_alloc], 1);
+    
+    /* a free block always follows an allocated one */
     if (prev_alloc && next_alloc) {
-        return ptr;
+        /* nothing to merge */
     } else if (prev_alloc && !next_alloc) {
+        remove_free(a, NEXT_BLKP(ptr));
         size += GET_SIZE(HDRP(NEXT_BLKP(ptr)));
-        PUT(HDRP(ptr), PACK(size, 0));
-        PUT(FTRP(ptr), PACK(size, 0));
+        PUT(HDRP(ptr), PACK(size, 1, 0));
+        PUT(FTRP(ptr), PACK(size, 1, 0));
     } else if (!prev_alloc && next_alloc) {
+        remove_free(a, PREV_BLKP(ptr));
         size += GET_SIZE(HDRP(PREV_BLKP(ptr)));
-        PUT(FTRP(ptr), PACK(size, 0));
-        PUT(HDRP(PREV_BLKP(ptr)), PACK(size, 0));
+        PUT(FTRP(ptr), PACK(size, 1, 0));
+        PUT(HDRP(PREV_BLKP(ptr)), PACK(size, 1, 0));
         ptr = PREV_BLKP(ptr);
     } else {
+        remove_free(a, PREV_BLKP(ptr));
+        remove_free(a, NEXT_BLKP(ptr));
         size += GET_SIZE(HDRP(PREV_BLKP(ptr))) + GET_SIZE(FTRP(NEXT_BLKP(ptr)));
-        PUT(HDRP(PREV_BLKP(ptr)), PACK(size, 0));
-        PUT(FTRP(NEXT_BLKP(ptr)), PACK(size, 0));
+        PUT(HDRP(PREV_BLKP(ptr)), PACK(size, 1, 0));
+        PUT(FTRP(NEXT_BLKP(ptr)), PACK(size, 1, 0));
         ptr = PREV_BLKP(ptr);
     }
+    insert_free(a, ptr);
     return ptr;
 }
 
 /*
- * mm_init - initialize the malloc package.
+ * free_block - Free the allocated block ptr. Built with
+ *     COALESCE_DEFERRED, a block of a quick list size is parked on its
+ *     quick list, until parking pushes the quick lists past QUICK_BYTES.
  */
-int mm_init(void)
+static void free_block(arena_t *a, void *ptr)
 {
-    if ((heap_listp = mem_sbrk(4*WSIZE)) == (void *)-1) {
-        return -1;
-    }
-    PUT(heap_listp, 0);
-    PUT(heap_listp + (1*WSIZE), PACK(DSIZE, 1));
-    PUT(heap_listp + (2*WSIZE), PACK(DSIZE, 1));
-    PUT(heap_listp + (3*WSIZE), PACK(0, 1));
-    heap_listp += (2*WSIZE);
+#if MM_COALESCE == COALESCE_DEFERRED
+    size_t size = GET_SIZE(HDRP(ptr));
     
-    /* extend the empty heap with a free block of CHUNKSIZE bytes */
-    if (extend_heap(CHUNKSIZE/WSIZE) == NULL)
-        return -1;
-    return 0;
+    if (IS_QUICK(size)) {
+        SET_NEXT_FREE(ptr, a->quick[QUICK_BIN(size)]);
+        a->quick[QUICK_BIN(size)] = ptr;
+        a->quick_bytes += size;
+        if (a->quick_bytes > QUICK_BYTES) {
+            quick_flush(a);
+        }
+        return;
+    }
+#endif
+    release_block(a, ptr);
 }
 
+#if MM_COALESCE == COALESCE_DEFERRED
 /*
- * mm_malloc - Allocate a block by incrementing the brk pointer.
- *     Always allocate a block whose size is a multiple of the alignment.
+ * quick_flush - Release every block parked on the arena's quick lists,
+ *     merging each with its free neighbours.
  */
-void *mm_malloc(size_t size)
+static void quick_flush(arena_t *a)
 {
-    size_t asize; /* adjusted block size */
-    size_t extendsize; /* amount to extend heap if no fit */
-    char *ptr;
+    int bin;
+    char *ptr, *next;
     
-    /* ignore spurious requests */
-    if (size == 0) {
-        return NULL;
+    for (bin = 0; bin < NUM_QUICK; bin++) {
+        for (ptr = a->quick[bin]; ptr != NULL; ptr = next) {
+            next = NEXT_FREE(ptr);
+            release_block(a, ptr);
+        }
+        a->quick[bin] = NULL;
     }
+    a->quick_bytes = 0;
+}
+#endif
+
+/*
+ * release_block - Mark the allocated block ptr free, merge it with its
+ *     free neighbours and trim the arena's region if that leaves a large
+ *     free block at its top.
+ */
+static void release_block(arena_t *a, void *ptr)
+{
+    size_t size = GET_SIZE(HDRP(ptr));
+    size_t prev_alloc = GET_PREV_ALLOC(HDRP(ptr));
     
-    /* adjust block size to include overhead and alignment requirements */
-    if (size <= DSIZE)
-        asize = 2 * DSIZE;
-    else
-        asize = DSIZE * ((size + (DSIZE) + (DSIZE - 1)) / DSIZE);
+    PUT(HDRP(ptr), PACK(size, prev_alloc, 0));
+    PUT(FTRP(ptr), PACK(size, prev_alloc, 0));
+    CLEAR_PREV_ALLOC(HDRP(NEXT_BLKP(ptr)));
+#if MM_COALESCE == COALESCE_NEVER
+    insert_free(a, ptr);
+#else
+    ptr = coalesce(a, ptr);
+#endif
+    if (GET_SIZE(HDRP(NEXT_BLKP(ptr))) == 0) {
+        trim_heap(a, ptr);
+    }
+}
+
+/*
+ * trim_heap - Give the region back to memlib above the first CHUNKSIZE
+ *     bytes, or the arena's reservation if larger, of ptr, the free block
+ *     at the top of the arena, once it has grown past trim_threshold
+ *     bytes.
+ */
+static void trim_heap(arena_t *a, void *ptr)
+{
+    size_t size = GET_SIZE(HDRP(ptr));
+    size_t keep = MIN(size, MAX(CHUNKSIZE, a->reserve));
+    size_t prev_alloc = GET_PREV_ALLOC(HDRP(ptr));
     
-    /* search the free list for a fit */
-    if ((ptr = find_fit(asize)) != NULL) {
-        place(ptr, asize);
-        return ptr;
+    if (trim_threshold < 0 || size <= (size_t)trim_threshold
+        || size == keep) {
+        return;
+    }
+    remove_free(a, ptr);
+    if (mem_sbrk_region(a->region, -(int)(size - keep)) == (void *)-1) {
+        insert_free(a, ptr);
+        return;
     }
+    STAT_ADD(trims, 1);
+    STAT_ADD(trim_bytes, size - keep);
+    PUT(HDRP(ptr), PACK(keep, prev_alloc, 0));
+    PUT(FTRP(ptr), PACK(keep, prev_alloc, 0));
+    PUT(HDRP(NEXT_BLKP(ptr)), PACK(0, 0, 1));    /* new epilogue header */
+    insert_free(a, ptr);
+}
+
+/*
+ * adjust_size - Return the block size for a request of size bytes, or 0
+ *     if no block of the heap could hold it. Checking this first also
+ *     keeps the rounding from wrapping around for sizes near SIZE_MAX.
+ */
+static size_t adjust_size(size_t size)
+{
+    /* adjust block size to include the header and alignment requirements */
+    if (size <= MIN_BLOCK - WSIZE)
+        return MIN_BLOCK;
+    if (size > MAX_HEAP)
+        return 0;
+    return ALIGN(size + WSIZE);
+}
+
+/*
+ * shrink_block - Cut the allocated block ptr down to asize bytes and free
+ *     the tail, if the tail is large enough to form a block of its own.
+ */
+static void shrink_block(arena_t *a, void *ptr, size_t asize)
+{
+    size_t csize = GET_SIZE(HDRP(ptr));
+    char *tail;
     
-    /* no fit found. get more memory and place block */
-    extendsize = MAX(asize, CHUNKSIZE);
-    if ((ptr = extend_heap(extendsize/WSIZE)) == NULL) {
-        return NULL;
+    if ((csize - asize) < MIN_BLOCK) {
+        return;
     }
-    place(ptr, asize);
-    return ptr;
+    PUT(HDRP(ptr), PACK(asize, GET_PREV_ALLOC(HDRP(ptr)), 1));
+    tail = NEXT_BLKP(ptr);
+    PUT(HDRP(tail), PACK(csize - asize, 1, 1));
+    free_block(a, tail);
 }
 
 /*
- * mm_free - Freeing a block does nothing.
+ * split_lead - Split the first lead bytes off the free block ptr into a
+ *     free block of their own and return the free block that follows.
+ *     lead must be zero or at least MIN_BLOCK.
  */
-void mm_free(void *ptr)
+static void *split_lead(arena_t *a, void *ptr, size_t lead)
 {
-    size_t size = GET_SIZE(HDRP(ptr));
-    PUT(HDRP(ptr), PACK(size, 0));
-    PUT(FTRP(ptr), PACK(size, 0));
-    coalesce(ptr);
+    size_t csize = GET_SIZE(HDRP(ptr));
+    size_t prev_alloc = GET_PREV_ALLOC(HDRP(ptr));
+    char *bp = (char *)ptr + lead;
+    
+    if (lead == 0) {
+        return ptr;
+    }
+    remove_free(a, ptr);
+    PUT(HDRP(ptr), PACK(lead, prev_alloc, 0));
+    PUT(FTRP(ptr), PACK(lead, prev_alloc, 0));
+    insert_free(a, ptr);
+    PUT(HDRP(bp), PACK(csize - lead, 0, 0));
+    PUT(FTRP(bp), PACK(csize - lead, 0, 0));
+    insert_free(a, bp);
+    return bp;
 }
 
 /*
- * mm_realloc - Implemented simply in terms of mm_malloc and mm_free
+ * slab_new_run - Carve a new run for slab class from the top of the heap.
+ *     The run's payload must start ALIGNMENT bytes past a run boundary,
+ *     so that the whole run page belongs to it.
  */
-void *mm_realloc(void *ptr, size_t size)
+static run_t *slab_new_run(arena_t *a, int class)
 {
-    void *oldptr = ptr;
-    void *newptr;
-    size_t copySize;
+    char *brk = (char *)mem_region_hi(a->region) + 1;
+    char *top;
+    char *bp;
+    size_t pad;
+    run_t *run;
+    
+    /* the run goes into the free block at the top of the heap, if any */
+    if ((top = top_block(a)) == NULL) {
+        top = brk;
+    }
+    bp = top;
+    pad = (RUN_SIZE - ((bp - heap_base - ALIGNMENT) & (RUN_SIZE - 1))) &
+        (RUN_SIZE - 1);
+    if (pad > 0 && pad < MIN_BLOCK) {
+        pad += RUN_SIZE;
+    }
+    bp += pad;
     
-    newptr = mm_malloc(size);
-    if (newptr == NULL)
+    /* grow the heap until the top free block covers the run */
+    if (bp + RUN_SIZE > brk && grow_heap(a, (bp + RUN_SIZE) - top) == NULL) {
         return NULL;
-    copySize = *(size_t *)((char *)oldptr - SIZE_T_SIZE);
-    if (size < copySize)
-        copySize = size;
-    memcpy(newptr, oldptr, copySize);
-    mm_free(oldptr);
-    return newptr;
+    }
+    bp = split_lead(a, top, pad);
+    place(a, bp, RUN_SIZE);
+    SET_SLAB(bp);
+    
+    run = (run_t *)bp;
+    run->slot_size = (class + 1) * ALIGNMENT;
+    run->nslots = (RUN_SIZE - ALIGNMENT - RUN_SLOTS) / run->slot_size;
+    run->nfree = run->nslots;
+    run->free_slots = 0;
+    run->bump = TO_OFF(bp + RUN_SLOTS);
+    slab_link(a, run, class);
+    return run;
+}
+
+static void slab_link(arena_t *a, run_t *run, int class)
+{
+    run_t *head = a->slab_runs[class];
+    
+    run->next = TO_OFF(head);
+    run->prev = 0;
+    if (head != NULL) {
+        head->prev = TO_OFF(run);
+    }
+    a->slab_runs[class] = run;
+}
+
+static void slab_unlink(arena_t *a, run_t *run, int class)
+{
+    run_t *next = (run_t *)FROM_OFF(run->next);
+    run_t *prev = (run_t *)FROM_OFF(run->prev);
+    
+    if (prev != NULL) {
+        prev->next = run->next;
+    } else {
+        a->slab_runs[class] = next;
+    }
+    if (next != NULL) {
+        next->prev = run->prev;
+    }
+}
+
+static void *slab_alloc(arena_t *a, int class)
+{
+    run_t *run = a->slab_runs[class];
+    char *slot;
+    
+    if (run == NULL && (run = slab_new_run(a, class)) == NULL) {
+        return NULL;
+    }
+    
+    /* prefer a recycled slot, otherwise bump into the untouched part */
+    if (run->free_slots != 0) {
+        slot = FROM_OFF(run->free_slots);
+        run->free_slots = GET(slot);
+    } else {
+        slot = FROM_OFF(run->bump);
+        run->bump += run->slot_size;
+    }
+    
+    /* full runs leave the list until one of their slots is freed */
+    if (--run->nfree == 0) {
+        slab_unlink(a, run, class);
+    }
+    return slot;
+}
+
+static void slab_free(arena_t *a, void *ptr)
+{
+    run_t *run = RUN_OF(ptr);
+    int class = SLOT_CLASS(ptr);
+    
+    PUT(ptr, run->free_slots);
+    run->free_slots = TO_OFF(ptr);
+    if (run->nfree++ == 0) {
+        slab_link(a, run, class);
+    }
+    
+    /* give an empty run back to the heap unless it is the only one left */
+    if (run->nfree == run->nslots && (run->next != 0 || run->prev != 0)) {
+        slab_unlink(a, run, class);
+        CLEAR_SLAB(run);
+        free_block(a, run);
+    }
+}
+
+#ifdef MM_THREADS
+/*
+ * cache_alloc - Pop a slot of slab class from the calling thread's cache,
+ *     refilling the cache from its arena's runs under the lock when empty.
+ */
+static void *cache_alloc(int class)
+{
+    arena_t *a;
+    char *slot;
+    int i, n = 0;
+    
+    cache_open();
+    
+    /* refill from the thread's arena, or the first other one with room */
+    for (i = 0; tcache.count[class] == 0 && i < num_arenas; i++) {
+        a = &arenas[(thread_arena() - arenas + i) % num_arenas];
+        LOCK(a);
+        for (n = 0; n < TCACHE_FILL; n++) {
+            if ((slot = slab_alloc(a, class)) == NULL) {
+                break;
+            }
+            *(char **)slot = tcache.slots[class];
+            tcache.slots[class] = slot;
+            tcache.count[class]++;
+        }
+        UNLOCK(a);
+        if (n > 0) {
+            my_arena = a;
+        }
+    }
+    if (tcache.count[class] == 0) {
+        return NULL;
+    }
+    slot = tcache.slots[class];
+    tcache.slots[class] = *(char **)slot;
+    tcache.count[class]--;
+    return slot;
+}
+
+/*
+ * cache_free - Push a slot of the given class onto the calling thread's
+ *     cache, flushing part of the cache back to the owning runs once it
+ *     is full.
+ */
+static void cache_free(void *ptr, int class)
+{
+    cache_open();
+    *(char **)ptr = tcache.slots[class];
+    tcache.slots[class] = ptr;
+    if (++tcache.count[class] >= TCACHE_MAX) {
+        cache_flush(class, TCACHE_FILL);
+    }
+}
+
+/*
+ * cache_open - Get the calling thread's cache ready for use: drop slots
+ *     left over from a dead heap and arm the destructor that flushes the
+ *     cache when the thread exits, whether it allocates or only frees.
+ */
+static void cache_open(void)
+{
+    /* slots cached before the last mm_init belong to a dead heap */
+    if (tcache.gen != heap_gen) {
+        memset(&tcache, 0, sizeof(tcache));
+        tcache.gen = heap_gen;
+    }
+    if (!tcache.registered) {
+        pthread_once(&tcache_once, cache_make_key);
+        pthread_setspecific(tcache_key, &tcache);
+        tcache.registered = 1;
+    }
+}
+
+static void cache_flush(int class, unsigned int n)
+{
+    arena_t *a = NULL;
+    arena_t *owner;
+    char *slot;
+    
+    /* slots may come from several arenas; lock each one only as needed */
+    while (n-- > 0 && tcache.count[class] > 0) {
+        slot = tcache.slots[class];
+        tcache.slots[class] = *(char **)slot;
+        tcache.count[class]--;
+        owner = ARENA_OF(slot);
+        if (owner != a) {
+            if (a != NULL) {
+                UNLOCK(a);
+            }
+            a = owner;
+            LOCK(a);
+        }
+        slab_free(a, slot);
+    }
+    if (a != NULL) {
+        UNLOCK(a);
+    }
+}
+
+static void cache_exit(void *arg)
+{
+    int class;
+    
+    if (tcache.gen != heap_gen) {
+        return;
+    }
+    for (class = 0; class < NUM_SLABS; class++) {
+        cache_flush(class, tcache.count[class]);
+    }
+}
+
+static void cache_make_key(void)
+{
+    pthread_key_create(&tcache_key, cache_exit);
+}
+#else
+/*
+ * cache_alloc - Without threads there is no cache: take a slot of slab
+ *     class straight from the thread's arena, or the first one with room.
+ */
+static void *cache_alloc(int class)
+{
+    arena_t *a;
+    char *slot;
+    int i;
+    
+    for (i = 0; i < num_arenas; i++) {
+        a = &arenas[(thread_arena() - arenas + i) % num_arenas];
+        if ((slot = slab_alloc(a, class)) != NULL) {
+            my_arena = a;
+            return slot;
+        }
+    }
+    return NULL;
+}
+#endif
+
+/*
+ * thread_arena - Return the calling thread's arena, assigning the next
+ *     one round-robin on the thread's first allocation after mm_init.
+ */
+static arena_t *thread_arena(void)
+{
+    unsigned int n;
+    
+    if (my_arena == NULL || my_gen != heap_gen) {
+#ifdef MM_THREADS
+        n = __sync_fetch_and_add(&next_arena, 1);
+#else
+        n = next_arena++;
+#endif
+        my_arena = &arenas[n % num_arenas];
+        my_gen = heap_gen;
+    }
+    return my_arena;
+}
+
+/*
+ * arena_alloc - Carry out req with fn in the calling thread's arena,
+ *     under its lock. If that arena is out of room, try each other arena
+ *     in turn, and have the thread move to the first one that serves it.
+ *     Returns what fn returned, or NULL if no arena has room.
+ */
+static void *arena_alloc(arena_fn fn, request_t *req)
+{
+    arena_t *a = thread_arena();
+    arena_t *other;
+    void *ptr;
+    int i;
+    
+    for (i = 0; i < num_arenas; i++) {
+        other = &arenas[(a - arenas + i) % num_arenas];
+        LOCK(other);
+        ptr = fn(other, req);
+        UNLOCK(other);
+        if (ptr != NULL) {
+            my_arena = other;
+            return ptr;
+        }
+    }
+    return NULL;
+}
+
+/* the arena_fn for each kind of request */
+static void *try_malloc(arena_t *a, request_t *req)
+{
+    return heap_malloc(a, req->size);
+}
+
+static void *try_calloc(arena_t *a, request_t *req)
+{
+    return heap_calloc(a, req->size);
+}
+
+static void *try_memalign(arena_t *a, request_t *req)
+{
+    return heap_memalign(a, req->alignment, req->size);
+}
+
+static void *try_batch(arena_t *a, request_t *req)
+{
+    if (!heap_malloc_batch(a, req->size, req->n, req->out)) {
+        return NULL;
+    }
+    return req->out;
+}
+
+/*
+ * arena_init - Lay down the prologue and epilogue at the start of the
+ *     arena's region and give it an initial free block.
+ */
+static int arena_init(arena_t *a)
+{
+    int class;
+    
+    if ((a->heap_listp = mem_sbrk_region(a->region, 4*WSIZE)) == (void *)-1) {
+        return -1;
+    }
+    for (class = 0; class < NUM_CLASSES; class++) {
+        a->seg_lists[class] = NULL;
+#if MM_FIT == FIT_NEXT
+        a->rovers[class] = NULL;
+#endif
+    }
+    a->tree_root = NULL;
+    a->grow = CHUNKSIZE;
+    a->idle_fits = 0;
+    a->reserve = 0;
+#if MM_COALESCE == COALESCE_DEFERRED
+    for (class = 0; class < NUM_QUICK; class++) {
+        a->quick[class] = NULL;
+    }
+    a->quick_bytes = 0;
+#endif
+    for (class = 0; class < NUM_SLABS; class++) {
+        a->slab_runs[class] = NULL;
+    }
+    PUT(a->heap_listp, 0);
+    PUT(a->heap_listp + (1*WSIZE), PACK(DSIZE, 1, 1));
+    PUT(a->heap_listp + (2*WSIZE), PACK(DSIZE, 1, 1));
+    PUT(a->heap_listp + (3*WSIZE), PACK(0, 1, 1));
+    a->heap_listp += (2*WSIZE);
+    
+    /* extend the empty heap with a free block of CHUNKSIZE bytes */
+    if (extend_heap(a, CHUNKSIZE/WSIZE) == NULL)
+        return -1;
+    return 0;
+}
+
+/*
+ * mm_init - initialize the malloc package with a single arena.
+ */
+int mm_init(void)
+{
+    return mm_init_arenas(1);
+}
+
+/*
+ * mm_init_arenas - initialize the malloc package with narenas arenas,
+ *     each carved from its own memlib region.
+ */
+int mm_init_arenas(int narenas)
+{
+#ifdef MM_THREADS
+    static int locks_ready = 0;
+#endif
+    int i;
+    
+    if (narenas < 1 || narenas > MAX_ARENAS) {
+        return -1;
+    }
+    if ((arena_span = mem_set_regions(narenas)) == 0) {
+        return -1;
+    }
+    heap_base = mem_heap_lo();
+    num_arenas = narenas;
+    next_arena = 0;
+    heap_gen++;
+    memset(run_map, 0, sizeof(run_map));
+#ifdef MM_STATS
+    memset(&stats, 0, sizeof(stats));
+#endif
+    
+#ifdef MM_THREADS
+    if (!locks_ready) {
+        for (i = 0; i < MAX_ARENAS; i++) {
+            pthread_mutex_init(&arenas[i].lock, NULL);
+        }
+        locks_ready = 1;
+    }
+#endif
+    for (i = 0; i < narenas; i++) {
+        arenas[i].region = i;
+        if (arena_init(&arenas[i]) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * mm_setopt - Set a tuning option of the malloc package. Options keep
+ *     their value across mm_init, and a negative threshold turns
+ *     trimming or mapping off. Returns 0, or -1 for an unknown option.
+ */
+int mm_setopt(int option, long value)
+{
+    switch (option) {
+    case MM_TRIM_THRESHOLD:
+        trim_threshold = value;
+        return 0;
+    case MM_MMAP_THRESHOLD:
+        mmap_threshold = value;
+        return 0;
+    default:
+        return -1;
+    }
+}
+
+/*
+ * mm_reserve - Grow the calling thread's arena until the free block at
+ *     its top holds bytes bytes, so that a burst of requests that size
+ *     adds up to is carved without extending the heap, and have trimming
+ *     leave that much in place from then on. mm_reserve(0) drops the
+ *     reservation. Returns 0, or -1 if the arena has no room for it.
+ */
+int mm_reserve(size_t bytes)
+{
+    arena_t *a;
+    char *top;
+    size_t have = 0;
+    int ret = 0;
+    
+    if (bytes > MAX_HEAP) {
+        return -1;
+    }
+    bytes = ALIGN(bytes);
+    a = thread_arena();
+    LOCK(a);
+    a->reserve = bytes;
+    if ((top = top_block(a)) != NULL) {
+        have = GET_SIZE(HDRP(top));
+    }
+    if (bytes > have &&
+        extend_heap(a, MAX(bytes - have, MIN_BLOCK)/WSIZE) == NULL) {
+        a->reserve = 0;
+        ret = -1;
+    }
+    UNLOCK(a);
+    return ret;
+}
+
+/*
+ * mm_stats - Copy the statistics gathered since the last mm_init into
+ *     *s. Returns 0, or -1 (with *s zeroed) if the package was built
+ *     without MM_STATS.
+ */
+int mm_stats(mm_stats_t *s)
+{
+#ifdef MM_STATS
+    *s = stats;
+    return 0;
+#else
+    memset(s, 0, sizeof(*s));
+    return -1;
+#endif
+}
+
+#ifdef MM_STATS
+/*
+ * log2_bin - Return the histogram bin of v: floor(log2(v)), or 0 for 0.
+ */
+static int log2_bin(size_t v)
+{
+    int bin = 0;
+    
+    while ((v >>= 1) != 0 && bin < MM_HIST_BINS - 1) {
+        bin++;
+    }
+    return bin;
+}
+#endif
+
+/*
+ * mm_malloc - Allocate a block from the segregated free lists,
+ *     extending the heap when no free block is large enough.
+ *     Always allocate a block whose size is a multiple of the alignment.
+ */
+void *mm_malloc(size_t size)
+{
+    request_t req;
+    
+    /* ignore spurious requests */
+    if (size == 0) {
+        return NULL;
+    }
+    STAT_ADD(mallocs, 1);
+    STAT_HIST(request_size, size);
+    
+    /* small requests are served headerless from slab runs */
+    if (size <= SLAB_MAX) {
+        return cache_alloc(SLAB_CLASS(size));
+    }
+    
+    /* huge requests get a mapping of their own */
+    if (IS_HUGE_REQUEST(size)) {
+        return huge_alloc(size);
+    }
+    
+    req.size = size;
+    return arena_alloc(try_malloc, &req);
+}
+
+/*
+ * heap_malloc - Allocate a boundary-tag block of at least size bytes
+ *     from arena a. The caller holds the arena's lock.
+ */
+static void *heap_malloc(arena_t *a, size_t size)
+{
+    size_t asize; /* adjusted block size */
+    char *ptr;
+    
+    if ((asize = adjust_size(size)) == 0) {
+        return NULL;
+    }
+    
+#if MM_COALESCE == COALESCE_DEFERRED
+    /* a parked block of just the right size is still marked allocated */
+    if (IS_QUICK(asize) && (ptr = a->quick[QUICK_BIN(asize)]) != NULL) {
+        a->quick[QUICK_BIN(asize)] = NEXT_FREE(ptr);
+        a->quick_bytes -= asize;
+        a->idle_fits++;
+        return ptr;
+    }
+#endif
+    
+    /* search the free list for a fit */
+#ifdef MM_STATS
+    fit_steps = 0;
+#endif
+    ptr = find_fit(a, asize);
+#if MM_COALESCE == COALESCE_DEFERRED
+    /* merge the parked blocks and look again before growing the heap */
+    if (ptr == NULL && a->quick_bytes > 0) {
+        quick_flush(a);
+        ptr = find_fit(a, asize);
+    }
+#endif
+    STAT_ADD(fit_searches, 1);
+    STAT_HIST(search_len, fit_steps);
+    if (ptr != NULL) {
+        a->idle_fits++;
+    } else {
+        STAT_ADD(fit_misses, 1);
+        
+        /* no fit found. get more memory and place block */
+        if ((ptr = grow_heap(a, asize)) == NULL) {
+            return NULL;
+        }
+    }
+#if MM_PLACE_HIGH > 0
+    /* small blocks fill free blocks from the end, so that they stay
+       apart from the large ones that fill them from the front */
+    if (asize < MM_PLACE_HIGH) {
+        return place_high(a, ptr, asize);
+    }
+#endif
+    place(a, ptr, asize);
+    return ptr;
+}
+
+/*
+ * mm_calloc - Allocate a zeroed array of nmemb elements of size bytes.
+ */
+void *mm_calloc(size_t nmemb, size_t size)
+{
+    request_t req;
+    size_t bytes = nmemb * size;
+    void *ptr;
+    
+    if (nmemb == 0 || size == 0 || bytes / nmemb != size) {
+        return NULL;
+    }
+    
+    /* a slot is too small for the watermark to pay off */
+    if (bytes <= SLAB_MAX) {
+        if ((ptr = mm_malloc(bytes)) != NULL) {
+            memset(ptr, 0, bytes);
+        }
+        return ptr;
+    }
+    
+    STAT_ADD(mallocs, 1);
+    STAT_HIST(request_size, bytes);
+    
+    /* a fresh mapping is zero already */
+    if (IS_HUGE_REQUEST(bytes)) {
+        return huge_alloc(bytes);
+    }
+    
+    req.size = bytes;
+    return arena_alloc(try_calloc, &req);
+}
+
+/*
+ * heap_calloc - Allocate a zeroed boundary-tag block of size bytes from
+ *     arena a, clearing only what was not known to be zero before the
+ *     block was allocated: memory at or above the region's zero
+ *     watermark has never been handed out, except for the links and
+ *     footer that extend_heap wrote there. The caller holds the arena's
+ *     lock.
+ */
+static void *heap_calloc(arena_t *a, size_t size)
+{
+    char *zero = mem_zero_lo(a->region);
+    char *ptr, *end, *ftr;
+    
+    /* heap_malloc turns down any size the heap cannot hold, so end
+       cannot wrap around */
+    if ((ptr = heap_malloc(a, size)) == NULL) {
+        return NULL;
+    }
+    end = ptr + size;
+    
+    /* recycled memory, and the links of a free block starting at zero */
+    if (end <= zero + 4*WSIZE) {
+        memset(ptr, 0, size);
+        return ptr;
+    }
+    if (ptr < zero + 4*WSIZE) {
+        memset(ptr, 0, zero + 4*WSIZE - ptr);
+    }
+    
+    /* the footer of the free block it was carved from, if the block ends
+       where that one did, as after extend_heap or place_high */
+    ftr = FTRP(ptr);
+    if (end > ftr) {
+        memset(MAX(ptr, ftr), 0, end - MAX(ptr, ftr));
+    }
+    return ptr;
+}
+
+/*
+ * mm_memalign - Allocate a block of size bytes whose payload address is
+ *     a multiple of alignment, which must be a power of two.
+ */
+void *mm_memalign(size_t alignment, size_t size)
+{
+    request_t req;
+    
+    if (size == 0 || alignment == 0 || (alignment & (alignment - 1)) != 0) {
+        return NULL;
+    }
+    
+    /* every block is aligned that much anyway */
+    if (alignment <= ALIGNMENT) {
+        return mm_malloc(size);
+    }
+    STAT_ADD(mallocs, 1);
+    STAT_HIST(request_size, size);
+    
+    req.size = size;
+    req.alignment = alignment;
+    return arena_alloc(try_memalign, &req);
+}
+
+/*
+ * heap_memalign - Allocate a boundary-tag block of at least size bytes
+ *     aligned to alignment from arena a: take a block large enough to
+ *     hold an aligned one at any offset, then free the slack before and
+ *     after it. The caller holds the arena's lock.
+ */
+static void *heap_memalign(arena_t *a, size_t alignment, size_t size)
+{
+    size_t asize = adjust_size(size);
+    size_t csize, lead;
+    char *ptr, *aligned;
+    
+    if (asize == 0 || alignment > MAX_HEAP) {
+        return NULL;
+    }
+    if ((ptr = heap_malloc(a, asize + alignment + MIN_BLOCK)) == NULL) {
+        return NULL;
+    }
+    
+    /* the leading slack must be empty or large enough to be freed */
+    lead = (alignment - ((unsigned long)ptr & (alignment - 1))) &
+        (alignment - 1);
+    if (lead > 0 && lead < MIN_BLOCK) {
+        lead += alignment;
+    }
+    if (lead > 0) {
+        csize = GET_SIZE(HDRP(ptr));
+        aligned = ptr + lead;
+        PUT(HDRP(ptr), PACK(lead, GET_PREV_ALLOC(HDRP(ptr)), 1));
+        PUT(HDRP(aligned), PACK(csize - lead, 1, 1));
+        free_block(a, ptr);
+        ptr = aligned;
+    }
+    shrink_block(a, ptr, asize);
+    return ptr;
+}
+
+/*
+ * huge_len - Return the length of the mapping that holds a huge block of
+ *     size bytes.
+ */
+static size_t huge_len(size_t size)
+{
+    size_t pagesize = mem_pagesize();
+    
+    return (size + HUGE_PAD + pagesize - 1) & ~(pagesize - 1);
+}
+
+/*
+ * huge_alloc - Map a block of its own for a request of size bytes.
+ */
+static void *huge_alloc(size_t size)
+{
+    size_t len = huge_len(size);
+    char *base;
+    
+    if (len < size || (base = mem_map(len)) == NULL) {
+        return NULL;
+    }
+    STAT_ADD(maps, 1);
+    *(size_t *)base = len;
+    return base + HUGE_PAD;
+}
+
+/*
+ * huge_realloc - Resize the mapping of the huge block ptr to hold size
+ *     bytes, letting memlib move it rather than copying the payload.
+ */
+static void *huge_realloc(void *ptr, size_t size)
+{
+    size_t len = huge_len(size);
+    char *base;
+    
+    if (len < size || (base = mem_remap(HUGE_BASE(ptr), len)) == NULL) {
+        return NULL;
+    }
+    *(size_t *)base = len;
+    return base + HUGE_PAD;
+}
+
+/*
+ * mm_free - Return a slot to its slab run, or mark the block free, merge
+ *     it with any free neighbours and put the result back on its free list.
+ *     A huge block is unmapped.
+ */
+void mm_free(void *ptr)
+{
+    arena_t *a;
+    
+    STAT_ADD(frees, 1);
+    if (IS_HUGE(ptr)) {
+        mem_unmap(HUGE_BASE(ptr));
+    } else if (IS_SLAB(ptr)) {
+        cache_free(ptr, SLOT_CLASS(ptr));
+    } else {
+        a = ARENA_OF(ptr);
+        LOCK(a);
+        free_block(a, ptr);
+        UNLOCK(a);
+    }
+}
+
+/*
+ * mm_free_sized - mm_free for a block whose size the caller knows: the
+ *     size last requested for it. A block too large for a slot skips the
+ *     slab lookup, and a slot takes its class from size rather than from
+ *     its run descriptor, which is safe because mm_realloc moves a slot
+ *     whose size leaves its class. Unless built with NDEBUG, a hint that does not
+ *     match the block fails an assertion.
+ */
+void mm_free_sized(void *ptr, size_t size)
+{
+    arena_t *a;
+    
+    if (ptr == NULL) {
+        return;
+    }
+    assert(size_hint_ok(ptr, size));
+    STAT_ADD(frees, 1);
+    if (IS_HUGE(ptr)) {
+        mem_unmap(HUGE_BASE(ptr));
+    } else if (size <= SLAB_MAX && IS_SLAB(ptr)) {
+        cache_free(ptr, SLAB_CLASS(size));
+    } else {
+        a = ARENA_OF(ptr);
+        LOCK(a);
+        free_block(a, ptr);
+        UNLOCK(a);
+    }
+}
+
+/*
+ * mm_usable_size - Return the number of bytes the block ptr can hold,
+ *     which may exceed the size requested for it.
+ */
+size_t mm_usable_size(void *ptr)
+{
+    if (ptr == NULL) {
+        return 0;
+    }
+    if (IS_HUGE(ptr)) {
+        return HUGE_LEN(ptr) - HUGE_PAD;
+    }
+    if (IS_SLAB(ptr)) {
+        return RUN_OF(ptr)->slot_size;
+    }
+    return GET_SIZE(HDRP(ptr)) - WSIZE;
+}
+
+#ifndef NDEBUG
+/*
+ * size_hint_ok - Tell whether size could have been requested for the
+ *     block ptr: no more than the block holds, and for a slot, a size
+ *     of the slot's own class.
+ */
+static int size_hint_ok(void *ptr, size_t size)
+{
+    if (size == 0 || size > mm_usable_size(ptr)) {
+        return 0;
+    }
+    return IS_HUGE(ptr) || !IS_SLAB(ptr) || SLAB_CLASS(size) == SLOT_CLASS(ptr);
+}
+#endif
+
+/*
+ * mm_realloc - Resize the block in place whenever possible: shrink by
+ *     splitting off the tail, grow into a free successor, or extend the
+ *     heap by exactly the missing amount when the block is the last one.
+ *     Only when none of these apply is the data copied to a new block.
+ */
+void *mm_realloc(void *ptr, size_t size)
+{
+    arena_t *a;
+    size_t asize, csize, oldsize;
+    long missing;
+    char *next;
+    void *newptr;
+    
+    if (ptr == NULL) {
+        return mm_malloc(size);
+    }
+    if (size == 0) {
+        mm_free(ptr);
+        return NULL;
+    }
+    STAT_ADD(reallocs, 1);
+    
+    if (IS_HUGE(ptr)) {
+        /* a huge block stays mapped as long as it is huge */
+        if (IS_HUGE_REQUEST(size)) {
+            return huge_realloc(ptr, size);
+        }
+        oldsize = HUGE_LEN(ptr) - HUGE_PAD;
+    } else if (IS_SLAB(ptr)) {
+        /* a slot stays put only within its class, so that a size hint
+           to mm_free_sized always names the class of the slot */
+        oldsize = RUN_OF(ptr)->slot_size;
+        if (size <= SLAB_MAX && SLAB_CLASS(size) == SLOT_CLASS(ptr)) {
+            return ptr;
+        }
+    } else {
+        a = ARENA_OF(ptr);
+        LOCK(a);
+        asize = adjust_size(size);
+        csize = GET_SIZE(HDRP(ptr));
+        if (asize == 0 && !IS_HUGE_REQUEST(size)) {
+            /* too large for the heap, and no mapping will take it */
+            UNLOCK(a);
+            return NULL;
+        }
+        if (asize != 0 && asize <= csize) {
+            shrink_block(a, ptr, asize);
+            UNLOCK(a);
+            return ptr;
+        }
+        
+        /* a block at the top of the heap grows by what it is missing,
+           unless it grows past the mmap threshold and moves to a mapping */
+        next = NEXT_BLKP(ptr);
+        if (IS_HUGE_REQUEST(size)) {
+            /* leave the region alone */
+        } else if (GET_SIZE(HDRP(next)) == 0 ||
+            (!GET_ALLOC(HDRP(next)) && GET_SIZE(HDRP(NEXT_BLKP(next))) == 0)) {
+            missing = asize - csize;
+            if (!GET_ALLOC(HDRP(next))) {
+                missing -= GET_SIZE(HDRP(next));
+            }
+            if (missing > 0) {
+                /* if the region is full, the move below may still fit */
+                extend_heap(a, MAX(missing, MIN_BLOCK)/WSIZE);
+            }
+        }
+        
+        /* absorb a free successor that makes up the difference */
+        if (!IS_HUGE_REQUEST(size) && !GET_ALLOC(HDRP(next)) &&
+            csize + GET_SIZE(HDRP(next)) >= asize) {
+            remove_free(a, next);
+            csize += GET_SIZE(HDRP(next));
+            PUT(HDRP(ptr), PACK(csize, GET_PREV_ALLOC(HDRP(ptr)), 1));
+            SET_PREV_ALLOC(HDRP(NEXT_BLKP(ptr)));
+            shrink_block(a, ptr, asize);
+            UNLOCK(a);
+            return ptr;
+        }
+        UNLOCK(a);
+        oldsize = csize - WSIZE;
+    }
+    
+    /* no room in place: move the data to a new block */
+    if ((newptr = mm_malloc(size)) == NULL) {
+        return NULL;
+    }
+    memcpy(newptr, ptr, MIN(size, oldsize));
+    mm_free(ptr);
+    return newptr;
+}
+
+/*
+ * mm_malloc_batch - Allocate n blocks of size bytes each and store them
+ *     in out. Returns the number of blocks allocated, which is less than
+ *     n only if memory ran out.
+ */
+size_t mm_malloc_batch(size_t size, size_t n, void **out)
+{
+    request_t req;
+    size_t asize, i;
+    
+    if (size == 0 || n == 0) {
+        return 0;
+    }
+    
+    /* slots and huge blocks are no cheaper to carve together */
+    if (size <= SLAB_MAX || IS_HUGE_REQUEST(size)) {
+        for (i = 0; i < n; i++) {
+            if ((out[i] = mm_malloc(size)) == NULL) {
+                break;
+            }
+        }
+        return i;
+    }
+    
+    asize = adjust_size(size);
+    if (asize == 0 || asize * n / n != asize) {
+        return 0;
+    }
+    STAT_ADD(mallocs, n);
+    STAT_HIST(request_size, size);
+    req.size = asize;
+    req.n = n;
+    req.out = out;
+    
+    /* no single fit anywhere: fall back to one block at a time */
+    if (arena_alloc(try_batch, &req) == NULL) {
+        for (i = 0; i < n; i++) {
+            if ((out[i] = mm_malloc(size)) == NULL) {
+                break;
+            }
+        }
+        return i;
+    }
+    return n;
+}
+
+/*
+ * heap_malloc_batch - Allocate one block for n blocks of asize bytes
+ *     from arena a and cut it up, the last block keeping any slack.
+ *     Returns 1, or 0 if there is no room. The caller holds the arena's
+ *     lock.
+ */
+static int heap_malloc_batch(arena_t *a, size_t asize, size_t n, void **out)
+{
+    size_t csize, i;
+    char *ptr;
+    
+    if ((ptr = heap_malloc(a, asize * n - WSIZE)) == NULL) {
+        return 0;
+    }
+    csize = GET_SIZE(HDRP(ptr));
+    for (i = 0; i < n - 1; i++) {
+        PUT(HDRP(ptr), PACK(asize, GET_PREV_ALLOC(HDRP(ptr)), 1));
+        out[i] = ptr;
+        ptr = NEXT_BLKP(ptr);
+        csize -= asize;
+        PUT(HDRP(ptr), PACK(csize, 1, 1));
+    }
+    out[n - 1] = ptr;
+    return 1;
+}
+
+/*
+ * mm_free_batch - Free the n blocks in ptrs, which is sorted by address
+ *     in the process. Each run of adjacent blocks is merged and freed as
+ *     one, under a single lock of its arena.
+ */
+void mm_free_batch(void **ptrs, size_t n)
+{
+    arena_t *a;
+    char *ptr;
+    size_t i, size;
+    
+    qsort(ptrs, n, sizeof(void *), ptr_cmp);
+    for (i = 0; i < n; i++) {
+        ptr = ptrs[i];
+        if (ptr == NULL) {
+            continue;
+        }
+        if (IS_HUGE(ptr) || IS_SLAB(ptr)) {
+            mm_free(ptr);
+            continue;
+        }
+        
+        /* extend the run while the next pointer is the next block */
+        size = GET_SIZE(HDRP(ptr));
+        STAT_ADD(frees, 1);
+        while (i + 1 < n && (char *)ptrs[i + 1] == ptr + size) {
+            size += GET_SIZE(HDRP(ptrs[++i]));
+            STAT_ADD(frees, 1);
+        }
+        a = ARENA_OF(ptr);
+        LOCK(a);
+        PUT(HDRP(ptr), PACK(size, GET_PREV_ALLOC(HDRP(ptr)), 1));
+        free_block(a, ptr);
+        UNLOCK(a);
+    }
+}
+
+/*
+ * ptr_cmp - qsort comparison of two pointers by address
+ */
+static int ptr_cmp(const void *x, const void *y)
+{
+    char *p = *(char **)x;
+    char *q = *(char **)y;
+    
+    return (p > q) - (p < q);
 }
@@ -1,9 +1,49 @@
 #include <stdio.h>
 
 extern int mm_init (void);
+extern int mm_init_arenas(int narenas);
 extern void *mm_malloc (size_t size);
 extern void mm_free (void *ptr);
+extern void mm_free_sized(void *ptr, size_t size);
+extern size_t mm_usable_size(void *ptr);
 extern void *mm_realloc(void *ptr, size_t size);
+extern void *mm_memalign(size_t alignment, size_t size);
+extern void *mm_calloc(size_t nmemb, size_t size);
+extern size_t mm_malloc_batch(size_t size, size_t n, void **out);
+extern void mm_free_batch(void **ptrs, size_t n);
+extern int mm_reserve(size_t bytes);
+
+/* options for mm_setopt */
+#define MM_TRIM_THRESHOLD 1 /* trim a top free block larger than this */
+#define MM_MMAP_THRESHOLD 2 /* map requests of at least this many bytes */
+extern int mm_setopt(int option, long value);
+
+/* 
+ * Allocator statistics since the last mm_init, filled in by mm_stats when
+ * the package is built with MM_STATS. Bin i of a histogram counts values
+ * in [2^i, 2^(i+1)), and bin 0 also counts zeros.
+ */
+#define MM_HIST_BINS 32
+typedef struct {
+    unsigned long mallocs;        /* blocks allocated, by any entry point */
+    unsigned long frees;          /* blocks freed */
+    unsigned long reallocs;       /* mm_realloc calls */
+    unsigned long fit_searches;   /* free block searches */
+    unsigned long fit_misses;     /* searches that found no fit */
+    unsigned long extends;        /* times the heap grew */
+    unsigned long extend_bytes;   /* bytes it grew by */
+    unsigned long trims;          /* times the heap was trimmed */
+    unsigned long trim_bytes;     /* bytes it was trimmed by */
+    unsigned long maps;           /* huge blocks mapped */
+    unsigned long coalesce[4];    /* frees merging nothing, next, prev, both */
+    unsigned long splits;         /* placed blocks split */
+    unsigned long split_waste;    /* bytes left in blocks too small to split */
+    unsigned long search_len[MM_HIST_BINS];   /* blocks visited per search */
+    unsigned long request_size[MM_HIST_BINS]; /* bytes per request */
+    unsigned long split_rem[MM_HIST_BINS];    /* bytes split off placed blocks */
+    unsigned long heap_growth[MM_HIST_BINS];  /* bytes per heap extension */
+} mm_stats_t;
+extern int mm_stats(mm_stats_t *stats);
 
 
 /* 
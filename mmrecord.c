@@ -0,0 +1,755 @@
+/*
+ * mmrecord - A library that, preloaded into a program, records its
+ *     malloc, calloc, realloc, free and aligned allocation requests as
+ *     a trace that mdriver can replay.
+ *
+ *     unix> LD_PRELOAD=./mmrecord.so MMRECORD_OUT=ls.rep ls -l
+ *     unix> mdriver -V -f ls.rep
+ *
+ *     MMRECORD_OUT names the trace, with any "%p" replaced by the
+ *     process id (the default is mmrecord.%p.rep), and MMRECORD_FORMAT
+ *     set to "binary" or "compressed" writes it in the binary format.
+ *
+ *     Each block gets a new id when it is allocated, which a table from
+ *     address to id finds again when the block is reallocated or freed.
+ *     The table is split into shards with locks of their own. Every
+ *     request draws its place in the program's order from a global
+ *     counter and goes into a buffer of the calling thread, and a full
+ *     buffer is appended to a spool file, so threads otherwise run
+ *     independently. At exit the spooled requests are put back in
+ *     order and written out as the trace, with a header that counts its
+ *     ids and requests.
+ *
+ *     Blocks allocated before the recorder started, or by functions it
+ *     does not intercept, are not in the table: freeing one is not
+ *     recorded and reallocating one is recorded as a new allocation.
+ *     Requests for 0 bytes are recorded as 1 byte, since mm_malloc
+ *     returns NULL for them. Children after a fork are not recorded,
+ *     and nothing is written if the program ends without calling exit.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dlfcn.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "trace.h"
+
+#define MAXLINE 1024            /* max string size */
+#define BUF_RECS 4096           /* requests a thread buffers */
+#define NUM_SHARDS 256          /* independently locked parts of the table */
+#define SHARD_MIN 1024          /* slots a shard starts with */
+#define BOOT_BYTES (64 * 1024)  /* memory for requests made by dlsym */
+
+/* thread-local, without the lazy allocation of the general TLS model */
+#define TLS __thread __attribute__((tls_model("initial-exec")))
+
+#define MIN(x, y) ((x) < (y) ? (x) : (y))
+
+/* Returns true if p was handed out from the boot memory */
+#define IS_BOOT(p) ((char *)(p) >= boot && (char *)(p) < boot + BOOT_BYTES)
+
+/* Mixes an address into the bits that pick its shard and slot */
+#define HASH(p) (((unsigned long long)(unsigned long)(p) >> 4) * \
+		 0x9e3779b97f4a7c15ULL)
+#define SHARD(h) ((h) >> 56)
+#define SLOT(h) ((size_t)((h) >> 16))
+
+/* A request as it is buffered and spooled */
+typedef struct {
+    unsigned long long seq;     /* its place in the program's order */
+    unsigned type;              /* ALLOC, FREE, ... as in traceop_t */
+    unsigned id;                /* id of the block */
+    unsigned size;              /* size asked for */
+    unsigned align;             /* alignment asked for */
+} record_t;
+
+/* A thread's requests that have not been spooled */
+typedef struct buffer_t {
+    pthread_mutex_t lock;       /* held while adding or spooling */
+    int n;                      /* requests in rec */
+    struct buffer_t *next;      /* next of all the buffers */
+    struct buffer_t *next_free; /* next buffer that no thread holds */
+    record_t rec[BUF_RECS];
+} buffer_t;
+
+/* A slot of the table, holding a block's address and id */
+typedef struct {
+    void *ptr;                  /* the block, or NULL if the slot is empty */
+    unsigned id;                /* its id */
+} slot_t;
+
+/* A part of the table, an open-addressed hash table */
+typedef struct {
+    pthread_mutex_t lock;       /* held while using the shard */
+    size_t mask;                /* slots - 1 */
+    size_t used;                /* slots holding a block */
+    slot_t *slots;
+} shard_t;
+
+/* The functions the recorder stands in front of */
+static void *(*real_malloc)(size_t);
+static void *(*real_calloc)(size_t, size_t);
+static void *(*real_realloc)(void *, size_t);
+static void (*real_free)(void *);
+static int (*real_posix_memalign)(void **, size_t, size_t);
+static void *(*real_aligned_alloc)(size_t, size_t);
+static void *(*real_memalign)(size_t, size_t);
+
+static char boot[BOOT_BYTES];   /* memory for requests made by dlsym */
+static size_t boot_used = 0;
+
+static volatile int recording = 0;  /* set while requests are recorded */
+static pid_t owner;             /* the process being recorded */
+static char out_path[MAXLINE];  /* where the trace goes */
+static int out_format = TRACE_TEXT;
+static int spool_fd = -1;       /* the unlinked spool file */
+static pthread_mutex_t spool_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static unsigned long long next_seq = 0;
+static unsigned next_id = 0;
+static shard_t shards[NUM_SHARDS];
+
+/* The buffers, and the ones left by threads that have exited */
+static buffer_t *all_buffers = NULL;
+static buffer_t *free_buffers = NULL;
+static pthread_mutex_t buffer_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t buffer_key;
+
+static TLS buffer_t *my_buffer = NULL;  /* this thread's buffer */
+static TLS int busy = 0;        /* set while the recorder is at work */
+static TLS int resolving = 0;   /* set while looking up the real functions */
+
+static int resolve(void);
+static void *boot_alloc(size_t size);
+static int enter(void);
+static void leave(void);
+static unsigned new_id(void *ptr);
+static void record(int type, unsigned id, size_t size, size_t align);
+static buffer_t *get_buffer(void);
+static void spool(buffer_t *b);
+static void thread_done(void *arg);
+static void in_child(void);
+static void table_insert(void *ptr, unsigned id);
+static int table_remove(void *ptr, unsigned *id);
+static void grow_shard(shard_t *s);
+static void *map_pages(size_t bytes);
+static void rec_error(char *msg);
+
+/*
+ * start - Begin recording, once the program is loaded
+ */
+__attribute__((constructor))
+static void start(void)
+{
+    char *s, *d;
+    char spool_path[MAXLINE + 8];
+    int i;
+
+    if (real_malloc == NULL && !resolve())
+	return;
+    busy = 1;
+    owner = getpid();
+
+    /* Name the trace, replacing %p with the process id */
+    if ((s = getenv("MMRECORD_OUT")) == NULL || *s == '\0')
+	s = "mmrecord.%p.rep";
+    for (d = out_path; *s && d < out_path + MAXLINE - 24; s++) {
+	if (s[0] == '%' && s[1] == 'p') {
+	    d += sprintf(d, "%d", (int)owner);
+	    s++;
+	} else {
+	    *d++ = *s;
+	}
+    }
+    *d = '\0';
+    if ((s = getenv("MMRECORD_FORMAT")) != NULL) {
+	if (!strcmp(s, "binary"))
+	    out_format = TRACE_BINARY;
+	else if (!strcmp(s, "compressed"))
+	    out_format = TRACE_BINARY_Z;
+	else if (strcmp(s, "text") != 0) {
+	    rec_error("MMRECORD_FORMAT must be text, binary or compressed");
+	    busy = 0;
+	    return;
+	}
+    }
+
+    /* Spool to a file that disappears with the process */
+    sprintf(spool_path, "%s.spool", out_path);
+    if ((spool_fd = open(spool_path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC,
+			 0600)) < 0) {
+	rec_error("could not create the spool file");
+	busy = 0;
+	return;
+    }
+    unlink(spool_path);
+
+    for (i = 0; i < NUM_SHARDS; i++)
+	pthread_mutex_init(&shards[i].lock, NULL);
+    pthread_key_create(&buffer_key, thread_done);
+    pthread_atfork(NULL, NULL, in_child);
+    recording = 1;
+    busy = 0;
+}
+
+/*
+ * finish - Stop recording at exit, put the spooled requests back in
+ *     the program's order and write them out as the trace
+ */
+__attribute__((destructor))
+static void finish(void)
+{
+    struct stat st;
+    record_t *rec;
+    trace_t trace;
+    traceop_t *op;
+    buffer_t *b;
+    unsigned *sizes;
+    unsigned long long num_seqs, i, n;
+    double live = 0, peak = 0;
+    int fd;
+
+    if (!recording || getpid() != owner)
+	return;
+    busy = 1;
+    recording = 0;
+
+    /* Spool what the threads still hold */
+    pthread_mutex_lock(&buffer_lock);
+    for (b = all_buffers; b != NULL; b = b->next) {
+	pthread_mutex_lock(&b->lock);
+	spool(b);
+	pthread_mutex_unlock(&b->lock);
+    }
+    pthread_mutex_unlock(&buffer_lock);
+
+    /* Take the spool file from under any late requests */
+    pthread_mutex_lock(&spool_lock);
+    fd = spool_fd;
+    spool_fd = -1;
+    pthread_mutex_unlock(&spool_lock);
+    if (fstat(fd, &st) < 0) {
+	rec_error("could not read the spool file");
+	return;
+    }
+    n = st.st_size / sizeof(record_t);
+    num_seqs = __atomic_load_n(&next_seq, __ATOMIC_SEQ_CST);
+    if (n > INT_MAX || num_seqs > INT_MAX) {
+	rec_error("too many requests for a trace");
+	return;
+    }
+    memset(&trace, 0, sizeof(trace));
+    rec = (n == 0) ? NULL : mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE,
+				 fd, 0);
+    trace.ops = map_pages((num_seqs + 1) * sizeof(traceop_t));
+    if (rec == MAP_FAILED || trace.ops == NULL) {
+	rec_error("out of memory writing the trace");
+	return;
+    }
+
+    /* Place each request by its number. A request that was under way
+       when recording stopped leaves a gap. */
+    for (i = 0; i < n; i++) {
+	op = &trace.ops[rec[i].seq];
+	op->type = rec[i].type;
+	op->index = rec[i].id;
+	op->size = rec[i].size;
+	op->align = rec[i].align;
+	op->count = 1;
+	if (rec[i].id >= trace.num_ids)
+	    trace.num_ids = rec[i].id + 1;
+    }
+
+    /* Squeeze out the gaps, and suggest a heap as large as the most
+       bytes ever live. A live id has a nonzero size, since every
+       recorded size is at least 1. */
+    if ((sizes = map_pages((trace.num_ids + 1) * sizeof(unsigned))) == NULL) {
+	rec_error("out of memory writing the trace");
+	return;
+    }
+    for (i = 0; i < num_seqs; i++) {
+	op = &trace.ops[i];
+	if (op->count == 0)
+	    continue;
+
+	/* The gap may have swallowed the allocation of a block that a
+	   later request frees or resizes: drop the free, and let the
+	   realloc allocate the block instead */
+	if (sizes[op->index] == 0) {
+	    if (op->type == FREE)
+		continue;
+	    if (op->type == REALLOC)
+		op->type = ALLOC;
+	}
+	if (op->type == FREE) {
+	    live -= sizes[op->index];
+	    sizes[op->index] = 0;
+	} else {
+	    live += op->size - (double)sizes[op->index];
+	    sizes[op->index] = op->size;
+	    if (live > peak)
+		peak = live;
+	}
+	trace.ops[trace.num_ops++] = *op;
+    }
+    trace.sugg_heapsize = (peak > INT_MAX) ? INT_MAX : peak;
+    trace.weight = 1;
+
+    if (trace.num_ops == 0)
+	fprintf(stderr, "mmrecord: no requests to write to %s\n", out_path);
+    else if (write_trace(&trace, out_path, out_format) == 0)
+	fprintf(stderr, "mmrecord: %d requests for %d ids in %s\n",
+		trace.num_ops, trace.num_ids, out_path);
+    if (rec != NULL)
+	munmap(rec, st.st_size);
+    munmap(trace.ops, (num_seqs + 1) * sizeof(traceop_t));
+    munmap(sizes, (trace.num_ids + 1) * sizeof(unsigned));
+    close(fd);
+}
+
+/*
+ * malloc - Record the allocation of a block
+ */
+void *malloc(size_t size)
+{
+    void *p;
+
+    if (real_malloc == NULL && !resolve())
+	return boot_alloc(size);
+    p = real_malloc(size);
+    if (p != NULL && enter()) {
+	record(ALLOC, new_id(p), size, 0);
+	leave();
+    }
+    return p;
+}
+
+/*
+ * calloc - Record the allocation of a cleared block
+ */
+void *calloc(size_t nmemb, size_t size)
+{
+    void *p;
+
+    if (real_calloc == NULL && !resolve()) {
+	if (size != 0 && nmemb > ((size_t)-1) / size)
+	    return NULL;
+	return boot_alloc(nmemb * size);   /* boot memory starts cleared */
+    }
+    p = real_calloc(nmemb, size);
+    if (p != NULL && enter()) {
+	record(CALLOC, new_id(p), nmemb * size, 0);
+	leave();
+    }
+    return p;
+}
+
+/*
+ * realloc - Record the resizing of a block, which keeps its id
+ */
+void *realloc(void *ptr, size_t size)
+{
+    void *p;
+    unsigned id;
+    int known = 0;
+    int entered;
+
+    if (ptr == NULL)
+	return malloc(size);
+    if (IS_BOOT(ptr)) {
+	/* boot blocks are never freed, so copying too much is safe */
+	if ((p = malloc(size)) != NULL)
+	    memcpy(p, ptr, MIN(size, (size_t)(boot + BOOT_BYTES - (char *)ptr)));
+	return p;
+    }
+    if (size == 0) {
+	free(ptr);
+	return NULL;
+    }
+    if (real_realloc == NULL && !resolve())
+	return NULL;
+
+    if ((entered = enter()))
+	known = table_remove(ptr, &id);
+    p = real_realloc(ptr, size);
+    if (entered) {
+	if (p == NULL) {
+	    if (known)
+		table_insert(ptr, id);      /* the old block lives on */
+	} else if (known) {
+	    table_insert(p, id);
+	    record(REALLOC, id, size, 0);
+	} else {
+	    record(ALLOC, new_id(p), size, 0);
+	}
+	leave();
+    }
+    return p;
+}
+
+/*
+ * free - Record the freeing of a block, before another thread can be
+ *     handed its address
+ */
+void free(void *ptr)
+{
+    unsigned id;
+
+    if (ptr == NULL || IS_BOOT(ptr))
+	return;
+    if (real_free == NULL && !resolve())
+	return;
+    if (enter()) {
+	if (table_remove(ptr, &id))
+	    record(FREE, id, 0, 0);
+	leave();
+    }
+    real_free(ptr);
+}
+
+/*
+ * posix_memalign - Record the allocation of an aligned block
+ */
+int posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+    int err;
+
+    if (real_posix_memalign == NULL && !resolve())
+	return ENOMEM;
+    err = real_posix_memalign(memptr, alignment, size);
+    if (err == 0 && enter()) {
+	record(MEMALIGN, new_id(*memptr), size, alignment);
+	leave();
+    }
+    return err;
+}
+
+/*
+ * aligned_alloc - Record the allocation of an aligned block
+ */
+void *aligned_alloc(size_t alignment, size_t size)
+{
+    void *p;
+
+    if (real_aligned_alloc == NULL && !resolve())
+	return NULL;
+    p = real_aligned_alloc(alignment, size);
+    if (p != NULL && enter()) {
+	record(MEMALIGN, new_id(p), size, alignment);
+	leave();
+    }
+    return p;
+}
+
+/*
+ * memalign - Record the allocation of an aligned block
+ */
+void *memalign(size_t alignment, size_t size)
+{
+    void *p;
+
+    if (real_memalign == NULL && !resolve())
+	return NULL;
+    p = real_memalign(alignment, size);
+    if (p != NULL && enter()) {
+	record(MEMALIGN, new_id(p), size, alignment);
+	leave();
+    }
+    return p;
+}
+
+/*
+ * resolve - Look up the functions the recorder stands in front of.
+ *     Returns false if called again while dlsym is at work, in which
+ *     case the caller serves the request from the boot memory.
+ */
+static int resolve(void)
+{
+    if (resolving)
+	return 0;
+    resolving = 1;
+    real_calloc = dlsym(RTLD_NEXT, "calloc");
+    real_realloc = dlsym(RTLD_NEXT, "realloc");
+    real_free = dlsym(RTLD_NEXT, "free");
+    real_posix_memalign = dlsym(RTLD_NEXT, "posix_memalign");
+    real_aligned_alloc = dlsym(RTLD_NEXT, "aligned_alloc");
+    real_memalign = dlsym(RTLD_NEXT, "memalign");
+    real_malloc = dlsym(RTLD_NEXT, "malloc");
+    resolving = 0;
+    if (real_malloc == NULL || real_free == NULL) {
+	rec_error("could not find the real malloc");
+	abort();
+    }
+    return 1;
+}
+
+/*
+ * boot_alloc - Allocate size bytes of the boot memory, which is never
+ *     freed, or return NULL if it is used up
+ */
+static void *boot_alloc(size_t size)
+{
+    size_t off;
+
+    size = (size + 15) & ~(size_t)15;
+    off = __atomic_fetch_add(&boot_used, size, __ATOMIC_RELAXED);
+    if (off + size > BOOT_BYTES || off + size < off)
+	return NULL;
+    return boot + off;
+}
+
+/*
+ * enter - Return true, and keep the recorder's own requests from being
+ *     recorded until leave(), if this request should be recorded
+ */
+static int enter(void)
+{
+    if (!recording || busy)
+	return 0;
+    busy = 1;
+    return 1;
+}
+
+/*
+ * leave - End what enter() began
+ */
+static void leave(void)
+{
+    busy = 0;
+}
+
+/*
+ * new_id - Give the block at ptr a new id
+ */
+static unsigned new_id(void *ptr)
+{
+    unsigned id = __atomic_fetch_add(&next_id, 1, __ATOMIC_RELAXED);
+
+    table_insert(ptr, id);
+    return id;
+}
+
+/*
+ * record - Add a request to this thread's buffer, spooling it if full
+ */
+static void record(int type, unsigned id, size_t size, size_t align)
+{
+    buffer_t *b = my_buffer;
+    record_t *r;
+
+    if (b == NULL && (b = get_buffer()) == NULL)
+	return;
+    pthread_mutex_lock(&b->lock);
+    if (b->n == BUF_RECS)
+	spool(b);
+    r = &b->rec[b->n++];
+    r->seq = __atomic_fetch_add(&next_seq, 1, __ATOMIC_SEQ_CST);
+    r->type = type;
+    r->id = id;
+    r->size = (size == 0) ? 1 : (size > INT_MAX) ? INT_MAX : size;
+    r->align = (align > INT_MAX) ? INT_MAX : align;
+    pthread_mutex_unlock(&b->lock);
+}
+
+/*
+ * get_buffer - Give this thread a buffer, or return NULL
+ */
+static buffer_t *get_buffer(void)
+{
+    buffer_t *b;
+
+    pthread_mutex_lock(&buffer_lock);
+    if ((b = free_buffers) != NULL) {
+	free_buffers = b->next_free;
+    } else if ((b = map_pages(sizeof(buffer_t))) != NULL) {
+	pthread_mutex_init(&b->lock, NULL);
+	b->next = all_buffers;
+	all_buffers = b;
+    }
+    pthread_mutex_unlock(&buffer_lock);
+    if (b == NULL) {
+	rec_error("out of memory for buffers");
+	return NULL;
+    }
+    my_buffer = b;
+    pthread_setspecific(buffer_key, b);
+    return b;
+}
+
+/*
+ * spool - Append a buffer's requests to the spool file and empty it.
+ *     The caller holds the buffer's lock.
+ */
+static void spool(buffer_t *b)
+{
+    char *p = (char *)b->rec;
+    size_t left = b->n * sizeof(record_t);
+    ssize_t len;
+
+    pthread_mutex_lock(&spool_lock);
+    while (left > 0 && spool_fd >= 0) {
+	if ((len = write(spool_fd, p, left)) < 0) {
+	    if (errno == EINTR)
+		continue;
+	    rec_error("could not write the spool file");
+	    recording = 0;
+	    break;
+	}
+	p += len;
+	left -= len;
+    }
+    pthread_mutex_unlock(&spool_lock);
+    b->n = 0;
+}
+
+/*
+ * thread_done - Spool an exiting thread's requests and free its buffer
+ */
+static void thread_done(void *arg)
+{
+    buffer_t *b = arg;
+
+    pthread_mutex_lock(&b->lock);
+    if (recording)
+	spool(b);
+    pthread_mutex_unlock(&b->lock);
+    my_buffer = NULL;
+    pthread_mutex_lock(&buffer_lock);
+    b->next_free = free_buffers;
+    free_buffers = b;
+    pthread_mutex_unlock(&buffer_lock);
+}
+
+/*
+ * in_child - Stop recording in a child after fork
+ */
+static void in_child(void)
+{
+    recording = 0;
+}
+
+/*
+ * table_insert - Note that the block at ptr has the given id
+ */
+static void table_insert(void *ptr, unsigned id)
+{
+    unsigned long long h = HASH(ptr);
+    shard_t *s = &shards[SHARD(h)];
+    size_t i;
+
+    pthread_mutex_lock(&s->lock);
+    if (s->slots == NULL || (s->used + 1) * 2 > s->mask + 1)
+	grow_shard(s);
+    if (s->slots != NULL && s->used < s->mask) {   /* keep a slot empty */
+	for (i = SLOT(h) & s->mask; s->slots[i].ptr != NULL;
+	     i = (i + 1) & s->mask)
+	    ;
+	s->slots[i].ptr = ptr;
+	s->slots[i].id = id;
+	s->used++;
+    }
+    pthread_mutex_unlock(&s->lock);
+}
+
+/*
+ * table_remove - Find the id of the block at ptr and forget the block.
+ *     Returns false if it is not in the table.
+ */
+static int table_remove(void *ptr, unsigned *id)
+{
+    unsigned long long h = HASH(ptr);
+    shard_t *s = &shards[SHARD(h)];
+    size_t i, j, k;
+    int found = 0;
+
+    pthread_mutex_lock(&s->lock);
+    if (s->slots != NULL) {
+	for (i = SLOT(h) & s->mask; s->slots[i].ptr != NULL;
+	     i = (i + 1) & s->mask) {
+	    if (s->slots[i].ptr == ptr) {
+		found = 1;
+		break;
+	    }
+	}
+    }
+    if (found) {
+	*id = s->slots[i].id;
+	s->used--;
+
+	/* Shift back the slots after it that would no longer be found */
+	for (j = (i + 1) & s->mask; s->slots[j].ptr != NULL;
+	     j = (j + 1) & s->mask) {
+	    k = SLOT(HASH(s->slots[j].ptr)) & s->mask;
+	    if ((i <= j) ? (i < k && k <= j) : (i < k || k <= j))
+		continue;
+	    s->slots[i] = s->slots[j];
+	    i = j;
+	}
+	s->slots[i].ptr = NULL;
+    }
+    pthread_mutex_unlock(&s->lock);
+    return found;
+}
+
+/*
+ * grow_shard - Double the slots of a shard (or give it its first ones)
+ *     and put its blocks back in them. The caller holds its lock.
+ */
+static void grow_shard(shard_t *s)
+{
+    size_t old_slots = s->slots ? s->mask + 1 : 0;
+    size_t new_slots = old_slots ? 2 * old_slots : SHARD_MIN;
+    slot_t *old = s->slots;
+    size_t i, j;
+
+    if ((s->slots = map_pages(new_slots * sizeof(slot_t))) == NULL) {
+	s->slots = old;
+	rec_error("out of memory for the table");
+	recording = 0;
+	return;
+    }
+    s->mask = new_slots - 1;
+    for (i = 0; i < old_slots; i++) {
+	if (old[i].ptr == NULL)
+	    continue;
+	for (j = SLOT(HASH(old[i].ptr)) & s->mask; s->slots[j].ptr != NULL;
+	     j = (j + 1) & s->mask)
+	    ;
+	s->slots[j] = old[i];
+    }
+    if (old != NULL)
+	munmap(old, old_slots * sizeof(slot_t));
+}
+
+/*
+ * map_pages - Return bytes of cleared memory straight from the kernel,
+ *     or NULL
+ */
+static void *map_pages(size_t bytes)
+{
+    void *p = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    return (p == MAP_FAILED) ? NULL : p;
+}
+
+/*
+ * rec_error - Report an error in the recorder
+ */
+static void rec_error(char *msg)
+{
+    static const char prefix[] = "mmrecord: ";
+
+    /* write(2) rather than stdio, which may call malloc */
+    if (write(2, prefix, sizeof(prefix) - 1) < 0 ||
+	write(2, msg, strlen(msg)) < 0 || write(2, "\n", 1) < 0)
+	return;
+}
@@ -0,0 +1,320 @@
+/*
+ * mmstress - Hammer the thread-safe malloc package from several threads
+ *     at once. Each thread keeps a table of live blocks, fills every
+ *     block it gets with a pattern and checks the pattern before it
+ *     resizes or frees the block, so that two threads handed the same
+ *     memory show up as corruption. Some blocks are passed through a
+ *     shared queue and freed by whichever thread takes them, so that
+ *     blocks and slab slots regularly die in a thread other than the
+ *     one that allocated them, and the threads that only free must
+ *     flush their caches on exit.
+ *
+ *     unix> mmstress -t 8 -n 4
+ *
+ *     The package is always built with MM_THREADS for this program.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "mm.h"
+#include "memlib.h"
+
+#define MAX_THREADS 64    /* most threads -t allows */
+#define SLOTS 1024        /* live blocks per thread */
+#define QUEUE 256         /* blocks in flight between threads */
+#define HUGE_SIZE 200000  /* above the default mmap threshold */
+
+/* a live block and the pattern byte it was filled with */
+typedef struct {
+    unsigned char *p;
+    size_t size;
+    unsigned char tag;
+} block_t;
+
+/* blocks handed from one thread to another to free */
+static block_t queue[QUEUE];
+static int queue_head, queue_tail;
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static long iterations = 100000; /* requests per thread */
+static int errors = 0;           /* blocks found corrupt */
+static pthread_mutex_t error_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void *worker(void *arg);
+static size_t pick_size(unsigned *seed);
+static int fill(block_t *b, int check_zero);
+static int check(block_t *b, size_t size);
+static void release(block_t *b, unsigned *seed);
+static int give(block_t *b);
+static int take(block_t *b);
+static void fail(block_t *b, char *msg);
+static void usage(void);
+
+int main(int argc, char **argv)
+{
+    pthread_t threads[MAX_THREADS];
+    int nthreads = 4, narenas = 0;
+    block_t b;
+    long i;
+    int c;
+
+    while ((c = getopt(argc, argv, "t:n:i:h")) != EOF) {
+	switch (c) {
+	case 't': /* Number of threads */
+	    nthreads = atoi(optarg);
+	    break;
+	case 'n': /* Number of arenas */
+	    narenas = atoi(optarg);
+	    break;
+	case 'i': /* Requests per thread */
+	    iterations = atol(optarg);
+	    break;
+	case 'h': /* Print this message */
+	    usage();
+	    exit(0);
+	default:
+	    usage();
+	    exit(1);
+	}
+    }
+    if (nthreads < 1 || nthreads > MAX_THREADS || iterations < 1) {
+	usage();
+	exit(1);
+    }
+    if (narenas == 0)
+	narenas = nthreads;
+
+    mem_init();
+    if (mm_init_arenas(narenas) < 0) {
+	fprintf(stderr, "mmstress: mm_init_arenas(%d) failed\n", narenas);
+	exit(1);
+    }
+    for (i = 0; i < nthreads; i++) {
+	if (pthread_create(&threads[i], NULL, worker, (void *)(i + 1)) != 0) {
+	    fprintf(stderr, "mmstress: pthread_create failed\n");
+	    exit(1);
+	}
+    }
+    for (i = 0; i < nthreads; i++)
+	pthread_join(threads[i], NULL);
+
+    /* free whatever is still waiting in the queue */
+    while (take(&b)) {
+	if (check(&b, b.size))
+	    mm_free(b.p);
+    }
+
+    printf("mmstress: %d threads, %d arenas, %ld requests each: %s "
+	   "(peak heap %lu bytes)\n", nthreads, narenas, iterations,
+	   errors ? "FAILED" : "ok", (unsigned long)mem_heap_peak());
+    exit(errors ? 1 : 0);
+}
+
+/*
+ * worker - Run a random mix of requests against the thread's own table
+ *     of blocks and the shared queue
+ */
+static void *worker(void *arg)
+{
+    unsigned seed = (unsigned)(long)arg;
+    block_t *blocks, b;
+    size_t size;
+    long it;
+    int i, r;
+
+    if ((blocks = calloc(SLOTS, sizeof(block_t))) == NULL) {
+	fail(NULL, "calloc failed");
+	return NULL;
+    }
+    for (it = 0; it < iterations; it++) {
+	i = rand_r(&seed) % SLOTS;
+	r = rand_r(&seed) % 16;
+
+	/* an empty slot gets a new block from one of the entry points */
+	if (blocks[i].p == NULL) {
+	    size = pick_size(&seed);
+	    blocks[i].size = size;
+	    blocks[i].tag = (unsigned char)rand_r(&seed);
+	    if (r < 10) {
+		blocks[i].p = mm_malloc(size);
+	    } else if (r < 13) {
+		blocks[i].p = mm_calloc(1, size);
+	    } else {
+		blocks[i].p = mm_memalign((size_t)32 << (r - 13), size);
+		if (blocks[i].p != NULL &&
+		    ((unsigned long)blocks[i].p & ((32UL << (r - 13)) - 1)) != 0)
+		    fail(&blocks[i], "misaligned mm_memalign block");
+	    }
+	    if (blocks[i].p == NULL) {
+		fail(&blocks[i], "out of memory");
+		continue;
+	    }
+	    if (!fill(&blocks[i], r >= 10 && r < 13))
+		blocks[i].p = NULL;
+	    continue;
+	}
+
+	/* a live one is resized, passed to another thread or freed */
+	if (!check(&blocks[i], blocks[i].size)) {
+	    blocks[i].p = NULL;
+	    continue;
+	}
+	if (r < 4) {
+	    size = pick_size(&seed);
+	    b = blocks[i];
+	    if ((blocks[i].p = mm_realloc(b.p, size)) == NULL) {
+		fail(&b, "mm_realloc failed");
+		continue;
+	    }
+	    if (!check(&blocks[i], size < b.size ? size : b.size)) {
+		blocks[i].p = NULL;
+		continue;
+	    }
+	    blocks[i].size = size;
+	    fill(&blocks[i], 0);
+	} else if (r < 8 && give(&blocks[i])) {
+	    blocks[i].p = NULL;
+	} else {
+	    release(&blocks[i], &seed);
+	}
+
+	/* free a block some other thread gave up */
+	if (r >= 12 && take(&b) && check(&b, b.size))
+	    release(&b, &seed);
+    }
+
+    for (i = 0; i < SLOTS; i++) {
+	if (blocks[i].p != NULL && check(&blocks[i], blocks[i].size))
+	    release(&blocks[i], &seed);
+    }
+    free(blocks);
+    return NULL;
+}
+
+/*
+ * pick_size - Draw a request size: mostly slab sizes, some heap sizes
+ *     and now and then a huge one
+ */
+static size_t pick_size(unsigned *seed)
+{
+    int r = rand_r(seed) % 100;
+
+    if (r < 70)
+	return 1 + rand_r(seed) % 128;
+    if (r < 99)
+	return 129 + rand_r(seed) % 4000;
+    return HUGE_SIZE + rand_r(seed) % HUGE_SIZE;
+}
+
+/*
+ * fill - Write the block's tag over its payload, after making sure that
+ *     a calloc'ed block reads as zero. Returns 0 if it did not.
+ */
+static int fill(block_t *b, int check_zero)
+{
+    size_t i;
+
+    if (check_zero) {
+	for (i = 0; i < b->size; i++) {
+	    if (b->p[i] != 0) {
+		fail(b, "mm_calloc block not zeroed");
+		return 0;
+	    }
+	}
+    }
+    memset(b->p, b->tag, b->size);
+    return 1;
+}
+
+/*
+ * check - Make sure the first size bytes of the block still hold its
+ *     tag. Returns 0 if they do not.
+ */
+static int check(block_t *b, size_t size)
+{
+    size_t i;
+
+    for (i = 0; i < size; i++) {
+	if (b->p[i] != b->tag) {
+	    fail(b, "block overwritten");
+	    return 0;
+	}
+    }
+    return 1;
+}
+
+/*
+ * release - Free the block, by size half of the time
+ */
+static void release(block_t *b, unsigned *seed)
+{
+    if (rand_r(seed) % 2)
+	mm_free_sized(b->p, b->size);
+    else
+	mm_free(b->p);
+    b->p = NULL;
+}
+
+/*
+ * give - Put the block on the shared queue. Returns 0 if it is full.
+ */
+static int give(block_t *b)
+{
+    int ok = 0;
+
+    pthread_mutex_lock(&queue_lock);
+    if (queue_head - queue_tail < QUEUE) {
+	queue[queue_head++ % QUEUE] = *b;
+	ok = 1;
+    }
+    pthread_mutex_unlock(&queue_lock);
+    return ok;
+}
+
+/*
+ * take - Take the oldest block off the shared queue into *b. Returns 0
+ *     if the queue is empty.
+ */
+static int take(block_t *b)
+{
+    int ok = 0;
+
+    pthread_mutex_lock(&queue_lock);
+    if (queue_head != queue_tail) {
+	*b = queue[queue_tail++ % QUEUE];
+	ok = 1;
+    }
+    pthread_mutex_unlock(&queue_lock);
+    return ok;
+}
+
+/*
+ * fail - Report a problem with block b, or with no block in particular
+ */
+static void fail(block_t *b, char *msg)
+{
+    pthread_mutex_lock(&error_lock);
+    errors++;
+    if (b != NULL)
+	fprintf(stderr, "ERROR: %s (%p, %lu bytes)\n", msg, (void *)b->p,
+		(unsigned long)b->size);
+    else
+	fprintf(stderr, "ERROR: %s\n", msg);
+    pthread_mutex_unlock(&error_lock);
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+    fprintf(stderr, "Usage: mmstress [-h] [-t <threads>] [-n <arenas>] [-i <requests>]\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-t <threads>   Run this many threads (default 4).\n");
+    fprintf(stderr, "\t-n <arenas>    Split the heap into this many arenas (default: one per thread).\n");
+    fprintf(stderr, "\t-i <requests>  Requests per thread (default 100000).\n");
+    fprintf(stderr, "\t-h             Print this message.\n");
+}
@@ -0,0 +1,761 @@
+/*
+ * trace.c - reads and writes the trace files that mdriver replays.
+ *
+ *     A text trace (.rep) is a header of four numbers (suggested heap
+ *     size, number of ids, number of requests, weight) followed by one
+ *     request per line: a type character and its decimal fields, such
+ *     as "a id size", "r id size" or "f id".
+ *
+ *     A binary trace holds the same requests in far fewer bytes. It
+ *     starts with a fixed header of 32-bit little-endian words:
+ *
+ *         "MMTR"  version  flags  sugg_heapsize  num_ids  num_ops  weight
+ *
+ *     followed by blocks, each a word with its unpacked length, a word
+ *     with its stored length and the stored bytes. A block whose two
+ *     lengths differ was compressed with zlib. Unpacked, a block is a
+ *     run of whole requests: the type character, then the same fields
+ *     as in the text format, each a base-128 varint. The id is stored
+ *     as the zigzag-encoded difference from the previous request's id,
+ *     since consecutive requests tend to name nearby ids.
+ *
+ *     read_trace tells the two formats apart by the magic number, maps
+ *     the file and decodes it in place. Compressed blocks need a build
+ *     with HAVE_ZLIB ("make ZLIB=1").
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "trace.h"
+
+#define MAXLINE 1024            /* max string size */
+#define TRACE_MAGIC "MMTR"      /* first bytes of a binary trace */
+#define TRACE_VERSION 1         /* binary format this file writes */
+#define TRACE_FLAG_Z 0x1        /* blocks were written compressed */
+#define HDR_WORDS 7             /* words in the binary header */
+#define BLOCK_SIZE (1<<20)      /* most unpacked bytes in a block */
+#define MAX_OP_BYTES 16         /* type byte and three 5-byte varints */
+
+/* Returns true if c separates the tokens of a text trace */
+#define IS_SPACE(c) ((c) == ' ' || (c) == '\n' || (c) == '\t' || (c) == '\r')
+
+/* A cursor over a text trace mapped into memory */
+typedef struct {
+    char *p;             /* next byte to scan */
+    char *end;           /* one past the last byte of the file */
+    int line;            /* line that p is on (origin 1) */
+} scanner_t;
+
+static char msg[MAXLINE];   /* for composing error messages */
+
+static trace_t *new_trace(unsigned *header);
+static int op_fields(char type);
+static int add_op(trace_t *trace, unsigned op_index, char type,
+		  unsigned *field, unsigned *max_index);
+static int check_trace(trace_t *trace, unsigned op_index, unsigned max_index);
+static int read_text(trace_t *trace, scanner_t *s);
+static int read_binary(trace_t *trace, unsigned char *p, unsigned char *end);
+static int scan_token(scanner_t *s);
+static int scan_uint(scanner_t *s, unsigned *val);
+static unsigned get_word(unsigned char *p);
+static void put_word(unsigned char *p, unsigned val);
+static int get_varint(unsigned char **pp, unsigned char *end, unsigned *val);
+static unsigned char *put_varint(unsigned char *p, unsigned val);
+static int write_text(trace_t *trace, FILE *fp);
+static int write_binary(trace_t *trace, FILE *fp, int compress);
+static int write_block(unsigned char *buf, size_t len, FILE *fp,
+		       int compress);
+static void trace_error(char *path, int line, char *msg);
+
+/*
+ * read_trace - read a trace file in either format and store it in
+ *     memory. The file is mapped rather than read and decoded in place.
+ *     A trace that cannot be opened, or that is malformed or disagrees
+ *     with its header, is reported with its line (or request) number
+ *     and yields NULL.
+ */
+trace_t *read_trace(char *tracedir, char *filename)
+{
+    int fd;
+    struct stat st;
+    char *map;
+    scanner_t s;
+    trace_t *trace = NULL;
+    char path[MAXLINE];
+    unsigned header[HDR_WORDS];
+    unsigned k;
+    int binary;
+
+    /* Map the whole trace file */
+    snprintf(path, MAXLINE, "%s%s", tracedir, filename);
+    if ((fd = open(path, O_RDONLY)) < 0) {
+	sprintf(msg, "Could not open trace: %s", strerror(errno));
+	trace_error(path, 0, msg);
+	return NULL;
+    }
+    if (fstat(fd, &st) < 0 || st.st_size == 0 ||
+	(map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0))
+	== MAP_FAILED) {
+	trace_error(path, 0, "Could not map trace");
+	close(fd);
+	return NULL;
+    }
+    close(fd);
+    s.p = map;
+    s.end = map + st.st_size;
+    s.line = 1;
+    binary = (st.st_size >= 4 && memcmp(map, TRACE_MAGIC, 4) == 0);
+
+    /* Read the trace file header */
+    if (binary) {
+	if (st.st_size < HDR_WORDS * 4) {
+	    trace_error(path, 0, "Truncated binary trace header");
+	    goto out;
+	}
+	for (k = 1; k < HDR_WORDS; k++)
+	    header[k] = get_word((unsigned char *)map + 4 * k);
+	if (header[1] != TRACE_VERSION) {
+	    sprintf(msg, "Binary trace version %u, expected %d",
+		    header[1], TRACE_VERSION);
+	    trace_error(path, 0, msg);
+	    goto out;
+	}
+    } else {
+	for (k = 3; k < HDR_WORDS; k++) {
+	    if (!scan_uint(&s, &header[k])) {
+		trace_error(path, s.line, "Bad trace header");
+		goto out;
+	    }
+	}
+    }
+    for (k = 3; k < HDR_WORDS; k++) {
+	if (header[k] > INT_MAX) {
+	    trace_error(path, binary ? 0 : s.line, "Bad trace header");
+	    goto out;
+	}
+    }
+    if ((trace = new_trace(&header[3])) == NULL) {
+	trace_error(path, 0, "Could not allocate the trace");
+	goto out;
+    }
+
+    /* Read the requests and check them against the header */
+    if (binary) {
+	trace->format = (header[2] & TRACE_FLAG_Z) ? TRACE_BINARY_Z
+	    : TRACE_BINARY;
+	if (read_binary(trace, (unsigned char *)map + HDR_WORDS * 4,
+			(unsigned char *)s.end) == 0) {
+	    trace_error(path, 0, msg);
+	    goto bad;
+	}
+    } else {
+	trace->format = TRACE_TEXT;
+	if (read_text(trace, &s) == 0) {
+	    trace_error(path, s.line, msg);
+	    goto bad;
+	}
+    }
+    munmap(map, st.st_size);
+    return trace;
+
+ bad:
+    free_trace(trace);
+ out:
+    munmap(map, st.st_size);
+    return NULL;
+}
+
+/*
+ * free_trace - Free the trace record and the three arrays it points
+ *              to, all of which were allocated in read_trace().
+ */
+void free_trace(trace_t *trace)
+{
+    free(trace->ops);         /* free the three arrays... */
+    free(trace->blocks);
+    free(trace->block_sizes);
+    free(trace);              /* and the trace record itself... */
+}
+
+/*
+ * new_trace - Allocate a trace record and its arrays for the header
+ *     words sugg_heapsize, num_ids, num_ops and weight, or return NULL
+ */
+static trace_t *new_trace(unsigned *header)
+{
+    trace_t *trace;
+
+    if ((trace = (trace_t *)calloc(1, sizeof(trace_t))) == NULL)
+	return NULL;
+    trace->sugg_heapsize = header[0]; /* not used */
+    trace->num_ids = header[1];
+    trace->num_ops = header[2];
+    trace->weight = header[3];        /* not used */
+
+    /* We'll store each request line in the trace in this array,
+       keep an array of pointers to the allocated blocks, along with
+       the corresponding byte sizes of each block */
+    trace->ops = (traceop_t *)malloc(trace->num_ops * sizeof(traceop_t));
+    trace->blocks = (char **)malloc(trace->num_ids * sizeof(char *));
+    trace->block_sizes = (size_t *)calloc(trace->num_ids, sizeof(size_t));
+    if ((trace->ops == NULL && trace->num_ops > 0) ||
+	(trace->blocks == NULL && trace->num_ids > 0) ||
+	(trace->block_sizes == NULL && trace->num_ids > 0)) {
+	free_trace(trace);
+	return NULL;
+    }
+    return trace;
+}
+
+/*
+ * op_fields - Return the number of fields that follow request type in
+ *     a trace, the block id first, or 0 if there is no such type
+ */
+static int op_fields(char type)
+{
+    switch (type) {
+    case 'f': case 's':
+	return 1;
+    case 'a': case 'r': case 'c': case 'd':
+	return 2;
+    case 'm': case 'b':
+	return 3;
+    default:
+	return 0;
+    }
+}
+
+/*
+ * add_op - Store request op_index of the trace from its type character
+ *     and fields, noting the size of each id it allocates in block_sizes
+ *     so that a sized free knows its size, and the highest such id in
+ *     *max_index. Returns 0, with the reason in msg, if the fields are
+ *     out of range.
+ */
+static int add_op(trace_t *trace, unsigned op_index, char type,
+		  unsigned *field, unsigned *max_index)
+{
+    traceop_t *op;
+    unsigned index, count, k;
+
+    if (op_index >= trace->num_ops) {
+	sprintf(msg, "More requests than the %d in the header",
+		trace->num_ops);
+	return 0;
+    }
+    for (k = 0; k < op_fields(type); k++) {
+	if (field[k] > INT_MAX) {
+	    sprintf(msg, "Number out of range in %c request", type);
+	    return 0;
+	}
+    }
+    op = &trace->ops[op_index];
+
+    /* Every id the request names must be one the header allows */
+    index = field[0];
+    count = (type == 'b' || type == 'd') ? field[1] : 1;
+    if (index >= trace->num_ids || count == 0 ||
+	count > trace->num_ids - index) {
+	sprintf(msg, "Block id out of range (the header has %d ids)",
+		trace->num_ids);
+	return 0;
+    }
+    op->index = index;
+    op->count = count;
+    op->align = 0;
+    op->size = 0;
+    switch (type) {
+    case 'a':
+	op->type = ALLOC;
+	op->size = field[1];
+	break;
+    case 'r':
+	op->type = REALLOC;
+	op->size = field[1];
+	break;
+    case 'c':
+	op->type = CALLOC;
+	op->size = field[1];
+	break;
+    case 'm':
+	op->type = MEMALIGN;
+	op->align = field[1];
+	op->size = field[2];
+	break;
+    case 'b':
+	op->type = ALLOC_BATCH;
+	op->size = field[2];
+	break;
+    case 'd':
+	op->type = FREE_BATCH;
+	break;
+    case 'f':
+	op->type = FREE;
+	break;
+    case 's':
+	op->type = FREE_SIZED;
+	op->size = trace->block_sizes[index];
+	break;
+    }
+    if (type != 'f' && type != 'd' && type != 's') {
+	for (k = index; k < index + count; k++)
+	    trace->block_sizes[k] = op->size;
+	if (index + count - 1 > *max_index)
+	    *max_index = index + count - 1;
+    }
+    return 1;
+}
+
+/*
+ * check_trace - Check that the header accounts for every request and
+ *     every id. Returns 0, with the reason in msg, if it does not.
+ */
+static int check_trace(trace_t *trace, unsigned op_index, unsigned max_index)
+{
+    if (op_index != trace->num_ops) {
+	sprintf(msg, "Only %u of the %d requests in the header",
+		op_index, trace->num_ops);
+	return 0;
+    }
+    if (max_index != trace->num_ids - 1) {
+	sprintf(msg, "Highest block id is %u, but the header has %d ids",
+		max_index, trace->num_ids);
+	return 0;
+    }
+    return 1;
+}
+
+/*
+ * read_text - Read the requests of a text trace from the scanner, which
+ *     stands just past the header. Returns 0, with the reason in msg and
+ *     the scanner on the offending line, if the trace is malformed.
+ */
+static int read_text(trace_t *trace, scanner_t *s)
+{
+    char type;
+    unsigned field[3];
+    unsigned max_index = 0;
+    unsigned op_index = 0;
+    int k;
+
+    while (scan_token(s)) {
+	/* The request type is a single character */
+	type = *s->p++;
+	if (s->p < s->end && !IS_SPACE(*s->p)) {
+	    sprintf(msg, "Bogus request type (%c...)", type);
+	    return 0;
+	}
+	if (op_fields(type) == 0) {
+	    sprintf(msg, "Bogus type character (%c)", type);
+	    return 0;
+	}
+	for (k = 0; k < op_fields(type); k++) {
+	    if (!scan_uint(s, &field[k])) {
+		sprintf(msg, "Bad or missing number in %c request", type);
+		return 0;
+	    }
+	}
+	if (add_op(trace, op_index, type, field, &max_index) == 0)
+	    return 0;
+	op_index++;
+    }
+    return check_trace(trace, op_index, max_index);
+}
+
+/*
+ * read_binary - Read the blocks of requests from p up to end into the
+ *     trace. Returns 0, with the reason in msg, if the trace is
+ *     malformed.
+ */
+static int read_binary(trace_t *trace, unsigned char *p, unsigned char *end)
+{
+    unsigned char *buf = NULL;
+    unsigned char *q, *qend;
+    unsigned raw_len, stored_len;
+    unsigned field[3];
+    unsigned max_index = 0;
+    unsigned op_index = 0;
+    unsigned prev = 0;
+    char type;
+    int k;
+
+    while (p < end) {
+	if (end - p < 8) {
+	    sprintf(msg, "Truncated block header after request %u",
+		    op_index);
+	    goto bad;
+	}
+	raw_len = get_word(p);
+	stored_len = get_word(p + 4);
+	p += 8;
+	if (stored_len > end - p || raw_len > BLOCK_SIZE) {
+	    sprintf(msg, "Bad block after request %u", op_index);
+	    goto bad;
+	}
+
+	/* Unpack a compressed block into buf */
+	q = p;
+	if (stored_len != raw_len) {
+#ifdef HAVE_ZLIB
+	    uLongf len = raw_len;
+
+	    if (buf == NULL && (buf = malloc(BLOCK_SIZE)) == NULL) {
+		sprintf(msg, "Could not allocate a block buffer");
+		goto bad;
+	    }
+	    if (uncompress(buf, &len, p, stored_len) != Z_OK || len != raw_len) {
+		sprintf(msg, "Corrupt compressed block after request %u",
+			op_index);
+		goto bad;
+	    }
+	    q = buf;
+#else
+	    sprintf(msg, "Compressed trace needs a ZLIB=1 build");
+	    goto bad;
+#endif
+	}
+	qend = q + raw_len;
+	p += stored_len;
+
+	/* Decode the requests in the block */
+	while (q < qend) {
+	    type = *q++;
+	    if (op_fields(type) == 0) {
+		sprintf(msg, "Bogus type character (%c) in request %u",
+			type, op_index);
+		goto bad;
+	    }
+	    for (k = 0; k < op_fields(type); k++) {
+		if (!get_varint(&q, qend, &field[k])) {
+		    sprintf(msg, "Bad number in request %u", op_index);
+		    goto bad;
+		}
+	    }
+	    /* undo the zigzag encoding of the id's difference */
+	    field[0] = prev + ((field[0] >> 1) ^ -(field[0] & 1));
+	    prev = field[0];
+	    if (add_op(trace, op_index, type, field, &max_index) == 0) {
+		sprintf(msg + strlen(msg), " in request %u", op_index);
+		goto bad;
+	    }
+	    op_index++;
+	}
+    }
+    free(buf);
+    return check_trace(trace, op_index, max_index);
+
+ bad:
+    free(buf);
+    return 0;
+}
+
+/*
+ * scan_token - Skip the white space in front of the scanner, counting
+ *     lines, and return true if a token follows it
+ */
+static int scan_token(scanner_t *s)
+{
+    while (s->p < s->end && IS_SPACE(*s->p)) {
+	if (*s->p == '\n')
+	    s->line++;
+	s->p++;
+    }
+    return s->p < s->end;
+}
+
+/*
+ * scan_uint - Scan an unsigned decimal number into *val. Returns false,
+ *     leaving the scanner on the offending line, if the next token is
+ *     not a number that fits in an unsigned int.
+ */
+static int scan_uint(scanner_t *s, unsigned *val)
+{
+    unsigned v = 0, d;
+    char *start;
+
+    if (!scan_token(s))
+	return 0;
+    for (start = s->p; s->p < s->end && *s->p >= '0' && *s->p <= '9'; s->p++) {
+	/* check before v grows, since an unsigned long may be no wider */
+	d = *s->p - '0';
+	if (v > (UINT_MAX - d) / 10)
+	    return 0;
+	v = v * 10 + d;
+    }
+    if (s->p == start || (s->p < s->end && !IS_SPACE(*s->p)))
+	return 0;
+    *val = v;
+    return 1;
+}
+
+/*
+ * get_word - Return the 32-bit little-endian word at p
+ */
+static unsigned get_word(unsigned char *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned)p[3] << 24);
+}
+
+/*
+ * put_word - Store val at p as a 32-bit little-endian word
+ */
+static void put_word(unsigned char *p, unsigned val)
+{
+    p[0] = val;
+    p[1] = val >> 8;
+    p[2] = val >> 16;
+    p[3] = val >> 24;
+}
+
+/*
+ * get_varint - Decode the varint at *pp, which must end before end,
+ *     into *val and advance *pp past it. Returns false if the varint is
+ *     cut off or does not fit in 32 bits.
+ */
+static int get_varint(unsigned char **pp, unsigned char *end, unsigned *val)
+{
+    unsigned char *p = *pp;
+    unsigned long long v = 0;  /* five bytes carry up to 35 bits */
+    int shift;
+
+    for (shift = 0; p < end && shift <= 28; shift += 7) {
+	v |= (unsigned long long)(*p & 0x7f) << shift;
+	if ((*p++ & 0x80) == 0) {
+	    if (v > UINT_MAX)
+		return 0;
+	    *val = (unsigned)v;
+	    *pp = p;
+	    return 1;
+	}
+    }
+    return 0;
+}
+
+/*
+ * put_varint - Encode val as a varint at p, seven bits a byte with the
+ *     high bit set on all but the last, and return the next free byte
+ */
+static unsigned char *put_varint(unsigned char *p, unsigned val)
+{
+    while (val >= 0x80) {
+	*p++ = (val & 0x7f) | 0x80;
+	val >>= 7;
+    }
+    *p++ = val;
+    return p;
+}
+
+/*
+ * write_trace - Write the trace to path in format TRACE_TEXT,
+ *     TRACE_BINARY or TRACE_BINARY_Z. Returns 0, or -1 after reporting
+ *     the error.
+ */
+int write_trace(trace_t *trace, char *path, int format)
+{
+    FILE *fp;
+    int ok;
+
+#ifndef HAVE_ZLIB
+    if (format == TRACE_BINARY_Z) {
+	trace_error(path, 0, "Compressed trace needs a ZLIB=1 build");
+	return -1;
+    }
+#endif
+    if ((fp = fopen(path, "wb")) == NULL) {
+	sprintf(msg, "Could not create trace: %s", strerror(errno));
+	trace_error(path, 0, msg);
+	return -1;
+    }
+    if (format == TRACE_TEXT)
+	ok = write_text(trace, fp);
+    else
+	ok = write_binary(trace, fp, format == TRACE_BINARY_Z);
+    if (fclose(fp) != 0)
+	ok = 0;
+    if (!ok) {
+	sprintf(msg, "Could not write trace: %s", strerror(errno));
+	trace_error(path, 0, msg);
+	return -1;
+    }
+    return 0;
+}
+
+/*
+ * write_text - Write the trace in the text format. Returns false if a
+ *     write failed.
+ */
+static int write_text(trace_t *trace, FILE *fp)
+{
+    traceop_t *op;
+    int i;
+
+    fprintf(fp, "%d\n%d\n%d\n%d\n", trace->sugg_heapsize, trace->num_ids,
+	    trace->num_ops, trace->weight);
+    for (i = 0; i < trace->num_ops; i++) {
+	op = &trace->ops[i];
+	switch (op->type) {
+	case ALLOC:
+	    fprintf(fp, "a %d %d\n", op->index, op->size);
+	    break;
+	case REALLOC:
+	    fprintf(fp, "r %d %d\n", op->index, op->size);
+	    break;
+	case CALLOC:
+	    fprintf(fp, "c %d %d\n", op->index, op->size);
+	    break;
+	case MEMALIGN:
+	    fprintf(fp, "m %d %d %d\n", op->index, op->align, op->size);
+	    break;
+	case ALLOC_BATCH:
+	    fprintf(fp, "b %d %d %d\n", op->index, op->count, op->size);
+	    break;
+	case FREE_BATCH:
+	    fprintf(fp, "d %d %d\n", op->index, op->count);
+	    break;
+	case FREE:
+	    fprintf(fp, "f %d\n", op->index);
+	    break;
+	case FREE_SIZED:
+	    fprintf(fp, "s %d\n", op->index);
+	    break;
+	}
+    }
+    return !ferror(fp);
+}
+
+/*
+ * write_binary - Write the trace in the binary format, compressing its
+ *     blocks if compress is set. Returns false if a write failed.
+ */
+static int write_binary(trace_t *trace, FILE *fp, int compress)
+{
+    unsigned char hdr[HDR_WORDS * 4];
+    unsigned char *buf, *p;
+    traceop_t *op;
+    unsigned prev = 0;
+    unsigned diff;
+    int i, ok = 1;
+
+    memcpy(hdr, TRACE_MAGIC, 4);
+    put_word(hdr + 4, TRACE_VERSION);
+    put_word(hdr + 8, compress ? TRACE_FLAG_Z : 0);
+    put_word(hdr + 12, trace->sugg_heapsize);
+    put_word(hdr + 16, trace->num_ids);
+    put_word(hdr + 20, trace->num_ops);
+    put_word(hdr + 24, trace->weight);
+    if (fwrite(hdr, sizeof(hdr), 1, fp) != 1)
+	return 0;
+    if ((buf = malloc(BLOCK_SIZE)) == NULL)
+	return 0;
+
+    /* pack whole requests into blocks of at most BLOCK_SIZE bytes */
+    p = buf;
+    for (i = 0; i < trace->num_ops && ok; i++) {
+	op = &trace->ops[i];
+	diff = (unsigned)op->index - prev;
+	diff = (diff << 1) ^ -(diff >> 31);   /* zigzag */
+	prev = op->index;
+	switch (op->type) {
+	case ALLOC:
+	    *p++ = 'a';
+	    p = put_varint(put_varint(p, diff), op->size);
+	    break;
+	case REALLOC:
+	    *p++ = 'r';
+	    p = put_varint(put_varint(p, diff), op->size);
+	    break;
+	case CALLOC:
+	    *p++ = 'c';
+	    p = put_varint(put_varint(p, diff), op->size);
+	    break;
+	case MEMALIGN:
+	    *p++ = 'm';
+	    p = put_varint(put_varint(put_varint(p, diff), op->align),
+			   op->size);
+	    break;
+	case ALLOC_BATCH:
+	    *p++ = 'b';
+	    p = put_varint(put_varint(put_varint(p, diff), op->count),
+			   op->size);
+	    break;
+	case FREE_BATCH:
+	    *p++ = 'd';
+	    p = put_varint(put_varint(p, diff), op->count);
+	    break;
+	case FREE:
+	    *p++ = 'f';
+	    p = put_varint(p, diff);
+	    break;
+	case FREE_SIZED:
+	    *p++ = 's';
+	    p = put_varint(p, diff);
+	    break;
+	}
+	if (p - buf > BLOCK_SIZE - MAX_OP_BYTES) {
+	    ok = write_block(buf, p - buf, fp, compress);
+	    p = buf;
+	}
+    }
+    if (ok && p > buf)
+	ok = write_block(buf, p - buf, fp, compress);
+    free(buf);
+    return ok;
+}
+
+/*
+ * write_block - Write the len bytes at buf as one block, compressed if
+ *     compress is set and compression makes it smaller. Returns false if
+ *     a write failed.
+ */
+static int write_block(unsigned char *buf, size_t len, FILE *fp,
+		       int compress)
+{
+    unsigned char hdr[8];
+    unsigned char *out = buf;
+    size_t out_len = len;
+#ifdef HAVE_ZLIB
+    unsigned char *z = NULL;
+    uLongf z_len;
+
+    if (compress) {
+	z_len = compressBound(len);
+	if ((z = malloc(z_len)) != NULL &&
+	    compress2(z, &z_len, buf, len, Z_DEFAULT_COMPRESSION) == Z_OK &&
+	    z_len < len) {
+	    out = z;
+	    out_len = z_len;
+	}
+    }
+#endif
+    put_word(hdr, len);
+    put_word(hdr + 4, out_len);
+    if (fwrite(hdr, sizeof(hdr), 1, fp) != 1 ||
+	fwrite(out, 1, out_len, fp) != out_len) {
+	out_len = 0;
+    }
+#ifdef HAVE_ZLIB
+    free(z);
+#endif
+    return out_len != 0;
+}
+
+/*
+ * trace_error - Report an error in a trace file, at line (if not 0)
+ */
+static void trace_error(char *path, int line, char *msg)
+{
+    if (line > 0)
+	printf("ERROR [%s, line %d]: %s\n", path, line, msg);
+    else
+	printf("ERROR [%s]: %s\n", path, msg);
+}
@@ -0,0 +1,32 @@
+#include <stddef.h>
+
+/* formats read_trace recognizes and write_trace can produce */
+#define TRACE_TEXT 0       /* the .rep text format */
+#define TRACE_BINARY 1     /* the packed binary format */
+#define TRACE_BINARY_Z 2   /* binary, with zlib-compressed blocks */
+
+/* Characterizes a single trace operation (allocator request) */
+typedef struct {
+    enum {ALLOC, FREE, REALLOC, MEMALIGN, CALLOC,
+	  ALLOC_BATCH, FREE_BATCH, FREE_SIZED} type; /* type of request */
+    int index;                        /* index for free() to use later */
+    int size;                         /* byte size of alloc/realloc request */
+    int align;                        /* alignment of a memalign request */
+    int count;                        /* ids index.. of a batch request */
+} traceop_t;
+
+/* Holds the information for one trace file*/
+typedef struct {
+    int sugg_heapsize;   /* suggested heap size (unused) */
+    int num_ids;         /* number of alloc/realloc ids */
+    int num_ops;         /* number of distinct requests */
+    int weight;          /* weight for this trace (unused) */
+    int format;          /* the TRACE_ format it was read in */
+    traceop_t *ops;      /* array of requests */
+    char **blocks;       /* array of ptrs returned by malloc/realloc... */
+    size_t *block_sizes; /* ... and a corresponding array of payload sizes */
+} trace_t;
+
+trace_t *read_trace(char *tracedir, char *filename);
+int write_trace(trace_t *trace, char *path, int format);
+void free_trace(trace_t *trace);
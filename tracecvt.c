@@ -0,0 +1,70 @@
+/*
+ * tracecvt - Convert a trace file between the text (.rep) format and
+ *     the binary format that mdriver also reads. By default the output
+ *     is in the format the input is not.
+ *
+ *     unix> tracecvt big.rep big.bin
+ *     unix> tracecvt -z big.rep big.bin
+ *     unix> tracecvt big.bin big.rep
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "trace.h"
+
+static void usage(void);
+
+int main(int argc, char **argv)
+{
+    trace_t *trace;
+    int format = -1;
+    int c;
+
+    while ((c = getopt(argc, argv, "tbzh")) != EOF) {
+	switch (c) {
+	case 't': /* Write the text format */
+	    format = TRACE_TEXT;
+	    break;
+	case 'b': /* Write the binary format */
+	    format = TRACE_BINARY;
+	    break;
+	case 'z': /* Write the binary format with compressed blocks */
+	    format = TRACE_BINARY_Z;
+	    break;
+	case 'h': /* Print this message */
+	    usage();
+	    exit(0);
+	default:
+	    usage();
+	    exit(1);
+	}
+    }
+    if (argc - optind != 2) {
+	usage();
+	exit(1);
+    }
+
+    if ((trace = read_trace("", argv[optind])) == NULL)
+	exit(1);
+    if (format < 0)
+	format = (trace->format == TRACE_TEXT) ? TRACE_BINARY : TRACE_TEXT;
+    if (write_trace(trace, argv[optind + 1], format) < 0)
+	exit(1);
+    free_trace(trace);
+    exit(0);
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+    fprintf(stderr, "Usage: tracecvt [-tbzh] <infile> <outfile>\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-t         Write a text trace.\n");
+    fprintf(stderr, "\t-b         Write a binary trace.\n");
+    fprintf(stderr, "\t-z         Write a binary trace with compressed blocks.\n");
+    fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "Without -t, -b or -z, the output is in the format the input is not.\n");
+}
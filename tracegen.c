@@ -0,0 +1,585 @@
+/*
+ * tracegen - Generate a trace file from a workload description, so that
+ *     the allocator can be run on heaps shaped like real programs' at
+ *     scales of millions of requests.
+ *
+ *     unix> tracegen service.wl service.rep
+ *     unix> tracegen -b -s 7 service.wl service.bin
+ *
+ *     A workload description is a list of settings, one per line, with
+ *     "#" starting a comment. Each "phase N" line emits N requests with
+ *     the settings given so far, so a later phase changes only what it
+ *     sets again:
+ *
+ *         seed S             seed for the random numbers (or -s S)
+ *         size DIST          sizes of new blocks, in bytes
+ *         life DIST          requests from a block's allocation (or
+ *                            realloc) to its next realloc or free
+ *         live BYTES         most payload bytes live at once: the
+ *                            blocks due soonest are freed early to keep
+ *                            under it (K, M and G suffixes; 0 for none)
+ *         realloc P G N      a new block is, with probability P, grown
+ *                            N times by a factor of G before it is freed
+ *         calloc P           a new block comes from calloc with
+ *                            probability P
+ *         phase N            emit N requests
+ *
+ *     A DIST is one of
+ *
+ *         fixed N            always N
+ *         uniform LO HI      uniform over LO..HI
+ *         pow2 LO HI         a power of two in LO..HI, each as likely
+ *         lognormal M S      log-normal with median M and shape S
+ *         exp MEAN           exponential with mean MEAN
+ *         hist B:W ...       bin B (a number or a range LO-HI) with
+ *                            weight W, as from a measured histogram
+ *         forever            never (for life only)
+ *
+ *     By default blocks are 8..512 bytes, live 1..1000 requests and
+ *     there is no live-bytes target. The blocks still live at the end
+ *     of the last phase are freed, so the trace is balanced.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <limits.h>
+
+#include "trace.h"
+
+#define MAXLINE 1024            /* max string size */
+#define MAX_BINS 256            /* most bins in a hist distribution */
+#define MAX_SIZE (1 << 30)      /* largest block a request asks for */
+#define FOREVER (~0ULL)         /* due time of a block never freed */
+
+/* A distribution that sizes and lifetimes are drawn from */
+typedef struct {
+    enum {D_FIXED, D_UNIFORM, D_POW2, D_LOGNORMAL, D_EXP, D_HIST,
+	  D_FOREVER} kind;
+    double a, b;                /* parameters, as given */
+    int nbins;                  /* bins of a hist distribution */
+    double lo[MAX_BINS];        /* lowest value in each bin */
+    double hi[MAX_BINS];        /* highest value in each bin */
+    double cum[MAX_BINS];       /* total weight up to each bin */
+} dist_t;
+
+/* The settings for one phase of the workload */
+typedef struct {
+    unsigned ops;               /* requests to emit */
+    dist_t size;                /* sizes of new blocks */
+    dist_t life;                /* requests between a block's events */
+    double live;                /* target live payload bytes (0 = none) */
+    double realloc_p;           /* chance a new block grows by realloc */
+    double growth;              /* factor each realloc grows it by */
+    unsigned chain;             /* reallocs before it is freed */
+    double calloc_p;            /* chance a new block comes from calloc */
+} phase_t;
+
+/* A block that is live in the trace, keyed by its next event */
+typedef struct {
+    unsigned long long due;     /* request at which its next event falls */
+    int id;                     /* its id in the trace */
+    int size;                   /* its current size */
+    unsigned reallocs;          /* reallocs left before it is freed */
+} object_t;
+
+/* The trace being built */
+static trace_t trace;
+static int max_ops = 0;         /* room in trace.ops */
+
+/* The live blocks, as a binary min-heap on due */
+static object_t *objs = NULL;
+static int num_objs = 0;
+static int max_objs = 0;
+static double live_bytes = 0;
+static double peak_bytes = 0;
+
+static unsigned long long rng_state = 1;  /* splitmix64 state */
+
+static void read_workload(char *path, phase_t **phases, int *num_phases);
+static void parse_dist(dist_t *d, char *path, int line);
+static double parse_num(char *tok, char *path, int line);
+static void run_phase(phase_t *p, unsigned long long *now);
+static void new_object(phase_t *p, int size, unsigned long long now);
+static void next_event(phase_t *p, unsigned long long now);
+static void free_object(void);
+static void push_object(object_t *o);
+static void pop_object(void);
+static void emit(int type, int index, int size);
+static double sample(dist_t *d);
+static double rand_unit(void);
+static double rand_normal(void);
+static void gen_error(char *path, int line, char *msg);
+static void usage(void);
+
+int main(int argc, char **argv)
+{
+    phase_t *phases;
+    int num_phases, i;
+    unsigned long long now = 0;
+    unsigned long long seed = 0;
+    int have_seed = 0;
+    int format = TRACE_TEXT;
+    int c;
+
+    while ((c = getopt(argc, argv, "bzs:h")) != EOF) {
+	switch (c) {
+	case 'b': /* Write the binary format */
+	    format = TRACE_BINARY;
+	    break;
+	case 'z': /* Write the binary format with compressed blocks */
+	    format = TRACE_BINARY_Z;
+	    break;
+	case 's': /* Seed the random numbers */
+	    seed = strtoull(optarg, NULL, 0);
+	    have_seed = 1;
+	    break;
+	case 'h': /* Print this message */
+	    usage();
+	    exit(0);
+	default:
+	    usage();
+	    exit(1);
+	}
+    }
+    if (argc - optind != 2) {
+	usage();
+	exit(1);
+    }
+
+    read_workload(argv[optind], &phases, &num_phases);
+    if (have_seed)
+	rng_state = seed;
+
+    /* Run the phases, then free whatever is still live */
+    for (i = 0; i < num_phases; i++)
+	run_phase(&phases[i], &now);
+    while (num_objs > 0)
+	free_object();
+
+    /* The field is an int and only a hint, so clamp rather than wrap */
+    trace.sugg_heapsize = (peak_bytes > INT_MAX) ? INT_MAX : (int)peak_bytes;
+    trace.weight = 1;
+    if (write_trace(&trace, argv[optind + 1], format) < 0)
+	exit(1);
+    printf("%s: %d requests, %d ids, peak of %.0f live bytes\n",
+	   argv[optind + 1], trace.num_ops, trace.num_ids, peak_bytes);
+    exit(0);
+}
+
+/*
+ * read_workload - Read the workload description at path into an array
+ *     of phases, reporting any error with its line number and exiting
+ */
+static void read_workload(char *path, phase_t **phases, int *num_phases)
+{
+    FILE *fp;
+    char buf[MAXLINE];
+    char msg[MAXLINE];
+    char *key, *tok;
+    phase_t cur;
+    int max_phases = 0;
+    int line = 0;
+
+    if ((fp = fopen(path, "r")) == NULL)
+	gen_error(path, 0, "Could not open workload");
+
+    /* the settings until the description says otherwise */
+    memset(&cur, 0, sizeof(cur));
+    cur.size.kind = D_UNIFORM;
+    cur.size.a = 8;
+    cur.size.b = 512;
+    cur.life.kind = D_UNIFORM;
+    cur.life.a = 1;
+    cur.life.b = 1000;
+    cur.growth = 2;
+    *phases = NULL;
+    *num_phases = 0;
+
+    while (fgets(buf, MAXLINE, fp) != NULL) {
+	line++;
+	if ((tok = strchr(buf, '#')) != NULL)
+	    *tok = '\0';
+	if ((key = strtok(buf, " \t\r\n")) == NULL)
+	    continue;
+
+	if (!strcmp(key, "seed")) {
+	    if ((tok = strtok(NULL, " \t\r\n")) == NULL)
+		gen_error(path, line, "Missing seed");
+	    rng_state = strtoull(tok, NULL, 0);
+	} else if (!strcmp(key, "size")) {
+	    parse_dist(&cur.size, path, line);
+	    if (cur.size.kind == D_FOREVER)
+		gen_error(path, line, "Sizes cannot be forever");
+	} else if (!strcmp(key, "life")) {
+	    parse_dist(&cur.life, path, line);
+	} else if (!strcmp(key, "live")) {
+	    cur.live = parse_num(strtok(NULL, " \t\r\n"), path, line);
+	} else if (!strcmp(key, "realloc")) {
+	    cur.realloc_p = parse_num(strtok(NULL, " \t\r\n"), path, line);
+	    cur.growth = parse_num(strtok(NULL, " \t\r\n"), path, line);
+	    cur.chain = parse_num(strtok(NULL, " \t\r\n"), path, line);
+	    if (cur.realloc_p > 1 || cur.growth < 1)
+		gen_error(path, line, "Bad realloc setting");
+	} else if (!strcmp(key, "calloc")) {
+	    cur.calloc_p = parse_num(strtok(NULL, " \t\r\n"), path, line);
+	    if (cur.calloc_p > 1)
+		gen_error(path, line, "Bad calloc probability");
+	} else if (!strcmp(key, "phase")) {
+	    cur.ops = parse_num(strtok(NULL, " \t\r\n"), path, line);
+	    if (*num_phases == max_phases) {
+		max_phases = max_phases ? 2 * max_phases : 8;
+		if ((*phases = realloc(*phases, max_phases * sizeof(phase_t)))
+		    == NULL)
+		    gen_error(path, line, "Out of memory");
+	    }
+	    (*phases)[(*num_phases)++] = cur;
+	} else {
+	    sprintf(msg, "Unknown setting (%s)", key);
+	    gen_error(path, line, msg);
+	}
+	if (strtok(NULL, " \t\r\n") != NULL)
+	    gen_error(path, line, "Extra fields in setting");
+    }
+    fclose(fp);
+    if (*num_phases == 0)
+	gen_error(path, 0, "No phase in workload");
+}
+
+/*
+ * parse_dist - Parse the rest of the current line as a distribution
+ */
+static void parse_dist(dist_t *d, char *path, int line)
+{
+    char *kind, *tok, *sep;
+    double total = 0;
+
+    if ((kind = strtok(NULL, " \t\r\n")) == NULL)
+	gen_error(path, line, "Missing distribution");
+    d->nbins = 0;
+    if (!strcmp(kind, "fixed")) {
+	d->kind = D_FIXED;
+	d->a = parse_num(strtok(NULL, " \t\r\n"), path, line);
+    } else if (!strcmp(kind, "uniform") || !strcmp(kind, "pow2")) {
+	d->kind = (kind[0] == 'u') ? D_UNIFORM : D_POW2;
+	d->a = parse_num(strtok(NULL, " \t\r\n"), path, line);
+	d->b = parse_num(strtok(NULL, " \t\r\n"), path, line);
+	if (d->kind == D_POW2) {
+	    /* keep the exponents, of the powers of two in range */
+	    d->a = ceil(log2(d->a > 1 ? d->a : 1));
+	    d->b = floor(log2(d->b > 1 ? d->b : 1));
+	}
+	if (d->a > d->b)
+	    gen_error(path, line, "Empty range");
+    } else if (!strcmp(kind, "lognormal")) {
+	d->kind = D_LOGNORMAL;
+	d->a = parse_num(strtok(NULL, " \t\r\n"), path, line);
+	d->b = parse_num(strtok(NULL, " \t\r\n"), path, line);
+    } else if (!strcmp(kind, "exp")) {
+	d->kind = D_EXP;
+	d->a = parse_num(strtok(NULL, " \t\r\n"), path, line);
+    } else if (!strcmp(kind, "hist")) {
+	d->kind = D_HIST;
+	while ((tok = strtok(NULL, " \t\r\n")) != NULL) {
+	    if (d->nbins == MAX_BINS)
+		gen_error(path, line, "Too many bins");
+	    if ((sep = strchr(tok, ':')) == NULL)
+		gen_error(path, line, "Bin without a weight");
+	    *sep = '\0';
+	    total += parse_num(sep + 1, path, line);
+	    d->cum[d->nbins] = total;
+	    if ((sep = strchr(tok, '-')) != NULL) {
+		*sep = '\0';
+		d->hi[d->nbins] = parse_num(sep + 1, path, line);
+	    }
+	    d->lo[d->nbins] = parse_num(tok, path, line);
+	    if (sep == NULL)
+		d->hi[d->nbins] = d->lo[d->nbins];
+	    if (d->lo[d->nbins] > d->hi[d->nbins])
+		gen_error(path, line, "Empty bin");
+	    d->nbins++;
+	}
+	if (total <= 0)
+	    gen_error(path, line, "Histogram without weight");
+    } else if (!strcmp(kind, "forever")) {
+	d->kind = D_FOREVER;
+    } else {
+	gen_error(path, line, "Unknown distribution");
+    }
+}
+
+/*
+ * parse_num - Parse a nonnegative number, which may end in K, M or G
+ */
+static double parse_num(char *tok, char *path, int line)
+{
+    char *end;
+    double val;
+
+    if (tok == NULL)
+	gen_error(path, line, "Missing number");
+    val = strtod(tok, &end);
+    switch (*end) {
+    case 'K': val *= 1 << 10; end++; break;
+    case 'M': val *= 1 << 20; end++; break;
+    case 'G': val *= 1 << 30; end++; break;
+    }
+    if (end == tok || *end != '\0' || !(val >= 0) || val > UINT_MAX)
+	gen_error(path, line, "Bad number");
+    return val;
+}
+
+/*
+ * run_phase - Emit the phase's requests. Each one is the next event of
+ *     the block due soonest if its time has come, else a free of that
+ *     block if a new one would overshoot the live-bytes target, else a
+ *     new block.
+ */
+static void run_phase(phase_t *p, unsigned long long *now)
+{
+    unsigned n;
+    int size = 0;
+
+    for (n = 0; n < p->ops; n++, (*now)++) {
+	if (size == 0)
+	    size = sample(&p->size);
+	if (num_objs > 0 && objs[0].due <= *now) {
+	    next_event(p, *now);
+	} else if (num_objs > 0 && p->live > 0 &&
+		   live_bytes + size > p->live) {
+	    free_object();
+	} else {
+	    new_object(p, size, *now);
+	    size = 0;
+	}
+    }
+}
+
+/*
+ * new_object - Allocate a block of size bytes at request now
+ */
+static void new_object(phase_t *p, int size, unsigned long long now)
+{
+    object_t o;
+    double life;
+
+    if (trace.num_ids == INT_MAX) {
+	fprintf(stderr, "tracegen: too many blocks for a trace\n");
+	exit(1);
+    }
+    o.id = trace.num_ids++;
+    o.size = size;
+    o.reallocs = (rand_unit() < p->realloc_p) ? p->chain : 0;
+    life = sample(&p->life);
+    o.due = (p->life.kind == D_FOREVER) ? FOREVER : now + life;
+    emit(rand_unit() < p->calloc_p ? CALLOC : ALLOC, o.id, size);
+    live_bytes += size;
+    if (live_bytes > peak_bytes)
+	peak_bytes = live_bytes;
+    push_object(&o);
+}
+
+/*
+ * next_event - Grow the block due soonest by realloc, if it has
+ *     reallocs left, and set its next event; otherwise free it
+ */
+static void next_event(phase_t *p, unsigned long long now)
+{
+    object_t o;
+    double size;
+
+    if (objs[0].reallocs == 0) {
+	free_object();
+	return;
+    }
+    o = objs[0];
+    pop_object();
+    size = ceil(o.size * p->growth);
+    if (size <= o.size)
+	size = o.size + 1;
+    if (size > MAX_SIZE)
+	size = MAX_SIZE;
+    live_bytes += size - o.size;
+    if (live_bytes > peak_bytes)
+	peak_bytes = live_bytes;
+    o.size = size;
+    o.reallocs--;
+    o.due = (p->life.kind == D_FOREVER) ? FOREVER : now + sample(&p->life);
+    emit(REALLOC, o.id, o.size);
+    push_object(&o);
+}
+
+/*
+ * free_object - Free the block due soonest
+ */
+static void free_object(void)
+{
+    emit(FREE, objs[0].id, 0);
+    live_bytes -= objs[0].size;
+    pop_object();
+}
+
+/*
+ * push_object - Add a block to the heap of live blocks
+ */
+static void push_object(object_t *o)
+{
+    int i, parent;
+
+    if (num_objs == max_objs) {
+	max_objs = max_objs ? 2 * max_objs : 1024;
+	if ((objs = realloc(objs, max_objs * sizeof(object_t))) == NULL) {
+	    fprintf(stderr, "tracegen: out of memory\n");
+	    exit(1);
+	}
+    }
+    for (i = num_objs++; i > 0; i = parent) {
+	parent = (i - 1) / 2;
+	if (objs[parent].due <= o->due)
+	    break;
+	objs[i] = objs[parent];
+    }
+    objs[i] = *o;
+}
+
+/*
+ * pop_object - Remove the block due soonest from the heap
+ */
+static void pop_object(void)
+{
+    object_t last = objs[--num_objs];
+    int i = 0, child;
+
+    while ((child = 2 * i + 1) < num_objs) {
+	if (child + 1 < num_objs && objs[child + 1].due < objs[child].due)
+	    child++;
+	if (last.due <= objs[child].due)
+	    break;
+	objs[i] = objs[child];
+	i = child;
+    }
+    objs[i] = last;
+}
+
+/*
+ * emit - Append a request to the trace
+ */
+static void emit(int type, int index, int size)
+{
+    traceop_t *op;
+
+    if (trace.num_ops == max_ops) {
+	if (max_ops == INT_MAX) {
+	    fprintf(stderr, "tracegen: too many requests for a trace\n");
+	    exit(1);
+	}
+	max_ops = (max_ops > INT_MAX / 2) ? INT_MAX
+	    : (max_ops ? 2 * max_ops : 1 << 16);
+	if ((trace.ops = realloc(trace.ops, max_ops * sizeof(traceop_t)))
+	    == NULL) {
+	    fprintf(stderr, "tracegen: out of memory\n");
+	    exit(1);
+	}
+    }
+    op = &trace.ops[trace.num_ops++];
+    op->type = type;
+    op->index = index;
+    op->size = size;
+    op->align = 0;
+    op->count = 1;
+}
+
+/*
+ * sample - Draw a whole number of at least 1 from a distribution
+ */
+static double sample(dist_t *d)
+{
+    double x = 0, w;
+    int lo, hi, mid;
+
+    switch (d->kind) {
+    case D_FIXED:
+	x = d->a;
+	break;
+    case D_UNIFORM:
+	x = d->a + floor(rand_unit() * (d->b - d->a + 1));
+	break;
+    case D_POW2:
+	x = ldexp(1, d->a + floor(rand_unit() * (d->b - d->a + 1)));
+	break;
+    case D_LOGNORMAL:
+	x = round(d->a * exp(d->b * rand_normal()));
+	break;
+    case D_EXP:
+	x = round(-d->a * log(1 - rand_unit()));
+	break;
+    case D_HIST:
+	/* find the first bin whose total weight exceeds w */
+	w = rand_unit() * d->cum[d->nbins - 1];
+	for (lo = 0, hi = d->nbins - 1; lo < hi; ) {
+	    mid = (lo + hi) / 2;
+	    if (d->cum[mid] > w)
+		hi = mid;
+	    else
+		lo = mid + 1;
+	}
+	x = d->lo[lo] + floor(rand_unit() * (d->hi[lo] - d->lo[lo] + 1));
+	break;
+    case D_FOREVER:
+	return FOREVER;
+    }
+    if (x < 1)
+	return 1;
+    return (x > MAX_SIZE) ? MAX_SIZE : x;
+}
+
+/*
+ * rand_unit - Return a random number in [0, 1), from splitmix64
+ */
+static double rand_unit(void)
+{
+    unsigned long long z = (rng_state += 0x9e3779b97f4a7c15ULL);
+
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    z ^= z >> 31;
+    return (z >> 11) * (1.0 / (1ULL << 53));
+}
+
+/*
+ * rand_normal - Return a standard normal random number (Box-Muller)
+ */
+static double rand_normal(void)
+{
+    double u = 1 - rand_unit();  /* in (0, 1], so log(u) is finite */
+
+    return sqrt(-2 * log(u)) * cos(2 * M_PI * rand_unit());
+}
+
+/*
+ * gen_error - Report an error in the workload, at line (if not 0), and
+ *     exit
+ */
+static void gen_error(char *path, int line, char *msg)
+{
+    if (line > 0)
+	printf("ERROR [%s, line %d]: %s\n", path, line, msg);
+    else
+	printf("ERROR [%s]: %s\n", path, msg);
+    exit(1);
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+    fprintf(stderr, "Usage: tracegen [-bzh] [-s <seed>] <workload> <outfile>\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-b         Write a binary trace.\n");
+    fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-s <seed>  Seed the random numbers.\n");
+    fprintf(stderr, "\t-z         Write a binary trace with compressed blocks.\n");
+    fprintf(stderr, "The workload format is described at the top of tracegen.c.\n");
+}